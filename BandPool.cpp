@@ -0,0 +1,263 @@
+#include "BandPool.h"
+#include <algorithm>
+#include <chrono>
+#include <assert.h>
+
+#define LATCH_SPIN 256      // yields before blocking, a band of a large frame takes longer than a wakeup
+#define BANDS_PER_THREAD 4  // a late worker only delays its last band
+#define MIN_BAND_ROWS 16
+
+void BandLatch::CountDown()
+{
+	// under the lock: once the waiter got the lock after the count reached zero, the latch can go away
+	std::lock_guard<std::mutex> autoLock(m_lock);
+	if (m_nCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		m_cond.notify_all();
+}
+
+void BandLatch::Wait()
+{
+	for (int i = 0; i < LATCH_SPIN && m_nCount.load(std::memory_order_acquire); i++)
+		std::this_thread::yield();
+
+	std::unique_lock<std::mutex> autoLock(m_lock);
+	m_cond.wait(autoLock, [this]() { return !m_nCount.load(std::memory_order_acquire); });
+}
+
+BandPool::~BandPool()
+{
+	assert(m_vQueues.empty());
+	StopWorkers();
+}
+
+void BandPool::SetThreads(uint32_t threads)
+{
+	std::lock_guard<std::mutex> autoLock(m_lockConfig);
+
+	if (threads > MAG_BAND_MAX_THREADS)
+		threads = MAG_BAND_MAX_THREADS;
+
+	if (threads == m_vWorkers.size())
+		return;
+
+	// bands claimed by the old workers are finished before they exit, the submitting threads run the rest
+	StopWorkers();
+	m_uThreads.store(threads, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < threads; i++)
+		m_vWorkers.emplace_back(&BandPool::WorkerThread, this);
+}
+
+void BandPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> autoLock(m_lock);
+		m_bStop = true;
+	}
+	m_cond.notify_all();
+
+	for (std::thread &worker : m_vWorkers)
+		worker.join();
+
+	m_vWorkers.clear();
+	m_uThreads.store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> autoLock(m_lock);
+	m_bStop = false;
+}
+
+ST_BandPoolStats BandPool::GetStats()
+{
+	std::lock_guard<std::mutex> autoLock(m_lock);
+
+	ST_BandPoolStats ret;
+	ret.threads = GetThreads();
+	ret.queues = (uint32_t)m_vQueues.size();
+	ret.queuedBands = CountQueuedBands();
+	ret.maxQueuedBands = m_uMaxQueued;
+	ret.jobs = m_nJobs;
+	ret.bands = m_nBands;
+	ret.stolenBands = m_nStolen.load(std::memory_order_relaxed);
+	return ret;
+}
+
+void BandPool::Attach(BandQueue *queue)
+{
+	std::lock_guard<std::mutex> autoLock(m_lock);
+	m_vQueues.push_back(queue);
+}
+
+void BandPool::Detach(BandQueue *queue)
+{
+	std::lock_guard<std::mutex> autoLock(m_lock);
+
+	assert(!queue->GetQueuedBands());
+	auto itr = std::find(m_vQueues.begin(), m_vQueues.end(), queue);
+	assert(itr != m_vQueues.end());
+	if (itr != m_vQueues.end())
+		m_vQueues.erase(itr);
+
+	if (m_uCursor >= m_vQueues.size())
+		m_uCursor = 0;
+}
+
+// Under m_lock, right after queue published a job
+void BandPool::Submit(BandQueue *queue)
+{
+	m_nJobs++;
+	m_nBands += queue->m_uBands;
+
+	uint32_t queued = CountQueuedBands();
+	if (queued > m_uMaxQueued)
+		m_uMaxQueued = queued;
+}
+
+// Under m_lock. Takes one band of the first queue with work after the round robin cursor,
+// the cursor moves past that queue so the next claim prefers another capture.
+BandQueue *BandPool::ClaimBand(uint32_t &band)
+{
+	size_t count = m_vQueues.size();
+	for (size_t i = 0; i < count; i++) {
+		size_t index = (m_uCursor + i) % count;
+		BandQueue *queue = m_vQueues[index];
+		if (!queue->GetQueuedBands())
+			continue;
+
+		// the submitting thread is one of the threads allowed on the queue
+		uint32_t limit = queue->m_uMaxThreads.load(std::memory_order_relaxed);
+		if (limit && queue->m_nHelpers.load(std::memory_order_relaxed) + 1 >= limit)
+			continue;
+
+		// the owner claims without the lock, it may have taken the last band meanwhile
+		uint32_t next = queue->m_nNext.fetch_add(1, std::memory_order_relaxed);
+		if (next >= queue->m_uBands)
+			continue;
+
+		queue->m_nHelpers.fetch_add(1, std::memory_order_relaxed);
+		m_uCursor = (index + 1) % count;
+		band = next;
+		return queue;
+	}
+
+	return nullptr;
+}
+
+// Under m_lock
+uint32_t BandPool::CountQueuedBands() const
+{
+	uint32_t queued = 0;
+	for (const BandQueue *queue : m_vQueues)
+		queued += queue->GetQueuedBands();
+
+	return queued;
+}
+
+void BandPool::WorkerThread()
+{
+	for (;;) {
+		BandQueue *queue = nullptr;
+		uint32_t band = 0;
+		{
+			std::unique_lock<std::mutex> autoLock(m_lock);
+			m_cond.wait(autoLock, [&]() { return m_bStop || (queue = ClaimBand(band)) != nullptr; });
+			if (!queue)
+				return;
+		}
+
+		queue->RunBand(band, true);
+	}
+}
+
+BandQueue::BandQueue(BandPool *pool) : m_pPool(pool)
+{
+	m_pPool->Attach(this);
+}
+
+BandQueue::~BandQueue()
+{
+	m_pPool->Detach(this);
+}
+
+ST_BandQueueStats BandQueue::GetStats() const
+{
+	ST_BandQueueStats ret;
+	ret.jobs = m_nJobs.load(std::memory_order_relaxed);
+	ret.bands = m_nBands.load(std::memory_order_relaxed);
+	ret.stolenBands = m_nStolen.load(std::memory_order_relaxed);
+	ret.waitMicros = m_nWaitMicros.load(std::memory_order_relaxed);
+	return ret;
+}
+
+void BandQueue::Dispatch(uint32_t rows, uint32_t align, BandFunc_t func, void *ctx)
+{
+	if (!align)
+		align = 1;
+
+	uint32_t threads = m_pPool->GetThreads() + 1;
+	uint32_t limit = m_uMaxThreads.load(std::memory_order_relaxed);
+	if (limit && threads > limit)
+		threads = limit;
+
+	uint32_t split = threads * BANDS_PER_THREAD;
+	uint32_t bandRows = (rows + split - 1) / split;
+	if (bandRows < MIN_BAND_ROWS)
+		bandRows = MIN_BAND_ROWS;
+	bandRows = (bandRows + align - 1) / align * align;
+
+	uint32_t bands = (rows + bandRows - 1) / bandRows;
+	if (threads <= 1 || bands <= 1) {
+		if (rows)
+			func(ctx, 0, rows);
+		return;
+	}
+
+	m_nJobs.fetch_add(1, std::memory_order_relaxed);
+	m_nBands.fetch_add(bands, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> autoLock(m_pPool->m_lock);
+		m_pFunc = func;
+		m_pCtx = ctx;
+		m_uRows = rows;
+		m_uBandRows = bandRows;
+		m_uBands = bands;
+		m_Latch.Reset(bands);
+		m_nNext.store(0, std::memory_order_relaxed);
+		m_pPool->Submit(this);
+	}
+	m_pPool->m_cond.notify_all();
+
+	// the submitting thread works on its own bands until the workers took the rest
+	for (;;) {
+		uint32_t band = m_nNext.fetch_add(1, std::memory_order_relaxed);
+		if (band >= bands)
+			break;
+		RunBand(band, false);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	m_Latch.Wait();
+	auto waited = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	m_nWaitMicros.fetch_add((uint64_t)waited.count(), std::memory_order_relaxed);
+}
+
+uint32_t BandQueue::GetQueuedBands() const
+{
+	uint32_t next = m_nNext.load(std::memory_order_relaxed);
+	return (next < m_uBands) ? m_uBands - next : 0;
+}
+
+void BandQueue::RunBand(uint32_t band, bool bStolen)
+{
+	uint32_t begin = band * m_uBandRows;
+	uint32_t end = (m_uRows - begin < m_uBandRows) ? m_uRows : begin + m_uBandRows;
+	m_pFunc(m_pCtx, begin, end);
+
+	if (bStolen) {
+		m_nStolen.fetch_add(1, std::memory_order_relaxed);
+		m_pPool->m_nStolen.fetch_add(1, std::memory_order_relaxed);
+		m_nHelpers.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// last access of a worker to the queue, the owner may return from Run right after
+	m_Latch.CountDown();
+}
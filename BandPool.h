@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <type_traits>
+#include <stdint.h>
+
+/*
+按行带并行处理帧的进程级共享线程池 (平台无关，只用 std::thread)
+每个采集持有一个 BandQueue，Run 把 [0, rows) 切成若干行带挂到自己的队列上，
+提交线程 (采集线程) 先处理自己的行带，池中空闲的工作线程从所有采集的队列中窃取行带。
+工作线程每处理完一个行带就按轮询顺序换到下一个有剩余行带的队列，多个采集同时提交时每个采集分到的线程数大致相同，
+SetMaxThreads 还可以限制单个采集同时占用的线程数。
+提交线程处理完能领到的行带后在完成闩 (BandLatch) 上等待，先短暂自旋，再阻塞在条件变量上。
+同一个 BandQueue 同时只能有一个 Run (由拥有者线程调用)，行带函数之间不能有共享的输出。
+*/
+
+#define MAG_BAND_MAX_THREADS 16
+
+struct ST_BandPoolStats {
+	uint32_t threads = 0;        // workers, the submitting threads are not counted
+	uint32_t queues = 0;         // one per capture
+	uint32_t queuedBands = 0;    // submitted and not claimed yet, over all queues
+	uint32_t maxQueuedBands = 0; // high water of queuedBands
+	uint64_t jobs = 0;
+	uint64_t bands = 0;
+	uint64_t stolenBands = 0; // run by a worker instead of the submitting thread
+};
+
+struct ST_BandQueueStats {
+	uint64_t jobs = 0;
+	uint64_t bands = 0;
+	uint64_t stolenBands = 0;
+	uint64_t waitMicros = 0; // submitting thread idle until stolen bands finished
+};
+
+// Counts finished bands, Wait returns once the count reached zero and CountDown does not touch the latch any more
+class BandLatch {
+public:
+	void Reset(uint32_t count) { m_nCount.store(count, std::memory_order_relaxed); }
+	void CountDown();
+	void Wait();
+
+private:
+	std::atomic<uint32_t> m_nCount = {0};
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+};
+
+class BandQueue;
+
+class BandPool {
+	friend class BandQueue;
+
+public:
+	BandPool() = default;
+	BandPool(const BandPool &) = delete;
+	BandPool &operator=(const BandPool &) = delete;
+	~BandPool();
+
+	// Worker threads besides the submitting ones, 0 runs every band on the thread calling Run
+	void SetThreads(uint32_t threads);
+	uint32_t GetThreads() const { return m_uThreads.load(std::memory_order_relaxed); }
+
+	ST_BandPoolStats GetStats();
+
+private:
+	void Attach(BandQueue *queue);
+	void Detach(BandQueue *queue);
+	void Submit(BandQueue *queue);
+	BandQueue *ClaimBand(uint32_t &band);
+	uint32_t CountQueuedBands() const;
+	void WorkerThread();
+	void StopWorkers();
+
+	std::mutex m_lockConfig; // serializes SetThreads
+	std::atomic<uint32_t> m_uThreads = {0};
+	std::vector<std::thread> m_vWorkers;
+
+	// guarded by m_lock
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	std::vector<BandQueue *> m_vQueues;
+	size_t m_uCursor = 0; // round robin start of the next claim
+	bool m_bStop = false;
+	uint32_t m_uMaxQueued = 0;
+	uint64_t m_nJobs = 0;
+	uint64_t m_nBands = 0;
+
+	std::atomic<uint64_t> m_nStolen = {0};
+};
+
+class BandQueue {
+	friend class BandPool;
+
+public:
+	explicit BandQueue(BandPool *pool);
+	BandQueue(const BandQueue &) = delete;
+	BandQueue &operator=(const BandQueue &) = delete;
+	~BandQueue();
+
+	// Threads working on one Run of this queue including the submitting one, 1 keeps every band on it, 0 for no limit
+	void SetMaxThreads(uint32_t threads) { m_uMaxThreads.store(threads, std::memory_order_relaxed); }
+
+	// Calls func(rowBegin, rowEnd) for bands covering [0, rows), every rowBegin is a multiple of align.
+	// Returns when all bands are done, their writes are visible to the caller.
+	template <typename F> void Run(uint32_t rows, uint32_t align, F &&func)
+	{
+		typedef typename std::remove_reference<F>::type Func_t;
+		Dispatch(rows, align, [](void *ctx, uint32_t begin, uint32_t end) { (*static_cast<Func_t *>(ctx))(begin, end); }, (void *)&func);
+	}
+
+	ST_BandQueueStats GetStats() const;
+
+private:
+	typedef void (*BandFunc_t)(void *ctx, uint32_t begin, uint32_t end);
+
+	void Dispatch(uint32_t rows, uint32_t align, BandFunc_t func, void *ctx);
+	uint32_t GetQueuedBands() const;
+	void RunBand(uint32_t band, bool bStolen);
+
+	BandPool *m_pPool;
+	std::atomic<uint32_t> m_uMaxThreads = {0};
+
+	// current job, written by the owner under the pool lock while no band is claimable
+	BandFunc_t m_pFunc = nullptr;
+	void *m_pCtx = nullptr;
+	uint32_t m_uRows = 0;
+	uint32_t m_uBandRows = 0;
+	uint32_t m_uBands = 0;
+	std::atomic<uint32_t> m_nNext = {0};    // next band to claim, may run past m_uBands
+	std::atomic<uint32_t> m_nHelpers = {0}; // workers running a band of this queue right now
+	BandLatch m_Latch;
+
+	std::atomic<uint64_t> m_nJobs = {0};
+	std::atomic<uint64_t> m_nBands = {0};
+	std::atomic<uint64_t> m_nStolen = {0};
+	std::atomic<uint64_t> m_nWaitMicros = {0};
+};
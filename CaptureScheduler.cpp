@@ -0,0 +1,143 @@
+#include "CaptureScheduler.h"
+#include <assert.h>
+
+#define NS_PER_SEC 1000000000ull
+
+static uint64_t Gcd(uint64_t a, uint64_t b)
+{
+	while (b) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+bool CaptureScheduler::ClampRate(uint32_t &num, uint32_t &den)
+{
+	if (!num || !den)
+		return false;
+
+	uint32_t gcd = (uint32_t)Gcd(num, den);
+	num /= gcd;
+	den /= gcd;
+	if (num <= MAG_SCHEDULE_MAX_NUM && den <= MAG_SCHEDULE_MAX_DEN)
+		return true;
+
+	// closest fraction within the limits: the last continued fraction convergent that fits, or the
+	// semiconvergent after it. Above MAG_SCHEDULE_MAX_NUM per second or below 1 per MAG_SCHEDULE_MAX_DEN
+	// seconds the rate ends up at that limit
+	uint64_t p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+	uint64_t x = num, y = den;
+	while (y) {
+		uint64_t a = x / y;
+		uint64_t p2 = p0 + a * p1, q2 = q0 + a * q1;
+		if (p2 > MAG_SCHEDULE_MAX_NUM || q2 > MAG_SCHEDULE_MAX_DEN)
+			break;
+
+		p0 = p1, q0 = q1, p1 = p2, q1 = q2;
+		uint64_t r = x - a * y;
+		x = y;
+		y = r;
+	}
+
+	if (!q1) {
+		num = MAG_SCHEDULE_MAX_NUM;
+		den = 1;
+		return true;
+	}
+
+	uint64_t t = UINT64_MAX;
+	if (p1)
+		t = (MAG_SCHEDULE_MAX_NUM - p0) / p1;
+	if ((MAG_SCHEDULE_MAX_DEN - q0) / q1 < t)
+		t = (MAG_SCHEDULE_MAX_DEN - q0) / q1;
+	uint64_t ps = p0 + t * p1, qs = q0 + t * q1;
+
+	// |p / q - num / den| compared as |p * den - num * q| / q, all products stay below 2^64
+	uint64_t err1 = (p1 * den > num * q1) ? p1 * den - num * q1 : num * q1 - p1 * den;
+	uint64_t errs = (ps * den > num * qs) ? ps * den - num * qs : num * qs - ps * den;
+	if (!p1 || (ps && errs * q1 < err1 * qs)) {
+		p1 = ps;
+		q1 = qs;
+	}
+
+	num = (uint32_t)p1;
+	den = (uint32_t)q1;
+	return true;
+}
+
+void CaptureScheduler::Start(uint32_t num, uint32_t den, uint64_t now)
+{
+	assert(num && den);
+	if (!ClampRate(num, den))
+		return;
+
+	m_nNum = num;
+	m_nDen = den;
+
+	m_nStart = now;
+	m_nIndex = 1;
+	m_bRunning = true;
+}
+
+// Exactly num deadlines fall into every den seconds, splitting off whole blocks keeps the products below 2^64
+uint64_t CaptureScheduler::GetDeadline(uint64_t index) const
+{
+	uint64_t block = NS_PER_SEC * m_nDen;
+	return m_nStart + (index / m_nNum) * block + (index % m_nNum) * block / m_nNum;
+}
+
+uint64_t CaptureScheduler::GetWait(uint64_t now) const
+{
+	uint64_t deadline = GetDeadline(m_nIndex);
+	return (deadline > now) ? deadline - now : 0;
+}
+
+bool CaptureScheduler::OnTick(uint64_t now)
+{
+	if (!m_bRunning)
+		return false;
+
+	uint64_t deadline = GetDeadline(m_nIndex);
+	if (now < deadline)
+		return false;
+
+	uint64_t lateness = now - deadline;
+	m_nTicks.fetch_add(1, std::memory_order_relaxed);
+	m_nLastLateness.store(lateness, std::memory_order_relaxed);
+	m_nTotalLateness.fetch_add(lateness, std::memory_order_relaxed);
+	if (lateness > m_nMaxLateness.load(std::memory_order_relaxed))
+		m_nMaxLateness.store(lateness, std::memory_order_relaxed);
+
+	// index of the last deadline at or before now, the next tick waits for the one after it
+	uint64_t block = NS_PER_SEC * m_nDen;
+	uint64_t elapsed = now - m_nStart;
+	uint64_t last = (elapsed / block) * m_nNum + (elapsed % block) * m_nNum / block;
+	if (GetDeadline(last + 1) <= now) // rounding of the division
+		last++;
+
+	m_nSkipped.fetch_add(last - m_nIndex, std::memory_order_relaxed);
+	m_nIndex = last + 1;
+	return true;
+}
+
+ST_ScheduleStats CaptureScheduler::GetStats() const
+{
+	ST_ScheduleStats ret;
+	ret.ticks = m_nTicks.load(std::memory_order_relaxed);
+	ret.skippedTicks = m_nSkipped.load(std::memory_order_relaxed);
+	ret.lastLateness = m_nLastLateness.load(std::memory_order_relaxed);
+	ret.maxLateness = m_nMaxLateness.load(std::memory_order_relaxed);
+	ret.totalLateness = m_nTotalLateness.load(std::memory_order_relaxed);
+	return ret;
+}
+
+void CaptureScheduler::ResetStats()
+{
+	m_nTicks = 0;
+	m_nSkipped = 0;
+	m_nLastLateness = 0;
+	m_nMaxLateness = 0;
+	m_nTotalLateness = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/*
+采集节拍的截止时间调度 (平台无关，时间由调用者传入，可以用假时钟测试)
+帧率是有理数 num / den (例如 30000 / 1001 = 29.97)，第 n 个截止时间总是 起点 + n * den / num 秒，
+按整数精确计算，不会因为逐次累加周期而漂移，某一拍晚了也不会推迟之后的截止时间。
+落后超过一个周期时跳过错过的截止时间 (计入 skippedTicks)，不会连续补拍。
+统计数据可以在任意线程读取。
+*/
+
+#define MAG_SCHEDULE_MAX_NUM 100000 // rate numerator after reduction, keeps the deadline math below 2^64
+#define MAG_SCHEDULE_MAX_DEN 10000
+
+struct ST_ScheduleStats {
+	uint64_t ticks = 0;
+	uint64_t skippedTicks = 0;   // deadlines passed while an earlier tick was still late
+	uint64_t lastLateness = 0;   // in ns, of the latest tick
+	uint64_t maxLateness = 0;    // in ns
+	uint64_t totalLateness = 0;  // in ns, divide by ticks for the mean
+};
+
+class CaptureScheduler {
+public:
+	// Reduces num / den and brings it within MAG_SCHEDULE_MAX_NUM / MAG_SCHEDULE_MAX_DEN, keeping the rate as close as possible.
+	// Returns false for a zero num or den, which is left alone
+	static bool ClampRate(uint32_t &num, uint32_t &den);
+
+	// Starts a schedule of num / den ticks per second (clamped by ClampRate), the first deadline is one period after now. Times are in ns
+	void Start(uint32_t num, uint32_t den, uint64_t now);
+	void Stop() { m_bRunning = false; }
+	bool IsRunning() const { return m_bRunning; }
+
+	// ns until the next deadline, 0 if it has passed
+	uint64_t GetWait(uint64_t now) const;
+
+	// Returns true if a deadline has passed, records its lateness and moves on to the first deadline after now
+	bool OnTick(uint64_t now);
+
+	uint64_t GetDeadline(uint64_t index) const;
+	ST_ScheduleStats GetStats() const;
+	void ResetStats();
+
+private:
+	bool m_bRunning = false;
+	uint64_t m_nNum = 0;
+	uint64_t m_nDen = 1;
+	uint64_t m_nStart = 0; // deadline 0
+	uint64_t m_nIndex = 0; // of the next deadline
+
+	std::atomic<uint64_t> m_nTicks = {0};
+	std::atomic<uint64_t> m_nSkipped = {0};
+	std::atomic<uint64_t> m_nLastLateness = {0};
+	std::atomic<uint64_t> m_nMaxLateness = {0};
+	std::atomic<uint64_t> m_nTotalLateness = {0};
+};
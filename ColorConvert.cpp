@@ -0,0 +1,386 @@
+#include "ColorConvert.h"
+#include "CpuFeatures.h"
+#include "KernelDispatch.h"
+#include "FrameAlignment.hpp"
+#include <assert.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAG_YUV_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MAG_ARCH_X86
+#include <immintrin.h>
+#endif
+
+#define YUV_SHIFT 14
+
+typedef void (*ConvertRowPair_t)(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c);
+
+static inline int16_t RoundCoef(double value)
+{
+	return (int16_t)(value < 0 ? value * (1 << YUV_SHIFT) - 0.5 : value * (1 << YUV_SHIFT) + 0.5);
+}
+
+void CalcYuvCoefs(MagColorMatrix matrix, MagColorRange range, ST_YuvCoefs &coefs)
+{
+	double kr = 0.299, kb = 0.114;
+	if (matrix == MAG_MATRIX_BT709) {
+		kr = 0.2126;
+		kb = 0.0722;
+	}
+
+	bool full = (range == MAG_RANGE_FULL);
+	double yScale = full ? 1.0 : 219.0 / 255.0;
+	double uvScale = full ? 1.0 : 224.0 / 255.0;
+
+	// G takes the rounding error, white stays white and grey has no chroma
+	coefs.yB = RoundCoef(kb * yScale);
+	coefs.yR = RoundCoef(kr * yScale);
+	coefs.yG = (int16_t)(RoundCoef(yScale) - coefs.yB - coefs.yR);
+
+	coefs.uB = RoundCoef(0.5 * uvScale);
+	coefs.uR = RoundCoef(-0.5 * uvScale * kr / (1.0 - kb));
+	coefs.uG = (int16_t)(-coefs.uB - coefs.uR);
+
+	coefs.vR = RoundCoef(0.5 * uvScale);
+	coefs.vB = RoundCoef(-0.5 * uvScale * kb / (1.0 - kr));
+	coefs.vG = (int16_t)(-coefs.vR - coefs.vB);
+
+	coefs.yRound = ((full ? 0 : 16) << YUV_SHIFT) + (1 << (YUV_SHIFT - 1));
+	coefs.uvRound = (128 << YUV_SHIFT) + (1 << (YUV_SHIFT - 1));
+}
+
+size_t CalcYuvLayout(MagYuvFormat format, uint32_t width, uint32_t height, size_t offsets[3], int32_t pitches[3])
+{
+	size_t chromaWidth = (width + 1) / 2;
+	size_t chromaHeight = (height + 1) / 2;
+
+	offsets[0] = offsets[1] = offsets[2] = 0;
+	pitches[0] = pitches[1] = pitches[2] = 0;
+	if (format == MAG_YUV_NONE)
+		return 0;
+
+	pitches[0] = (int32_t)AlignUp(width, MAG_CACHE_LINE);
+	size_t size = size_t(pitches[0]) * height;
+
+	if (format == MAG_YUV_NV12) {
+		pitches[1] = (int32_t)AlignUp(chromaWidth * 2, MAG_CACHE_LINE);
+		offsets[1] = size;
+		size += size_t(pitches[1]) * chromaHeight;
+	} else {
+		pitches[1] = pitches[2] = (int32_t)AlignUp(chromaWidth, MAG_CACHE_LINE);
+		offsets[1] = size;
+		size += size_t(pitches[1]) * chromaHeight;
+		offsets[2] = size;
+		size += size_t(pitches[2]) * chromaHeight;
+	}
+
+	return size;
+}
+
+static inline uint8_t Clamp255(int32_t value)
+{
+	return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline uint8_t Luma_C(const uint8_t *px, const ST_YuvCoefs &c)
+{
+	return Clamp255((c.yB * px[0] + c.yG * px[1] + c.yR * px[2] + c.yRound) >> YUV_SHIFT);
+}
+
+// Reference implementation, also converts the columns the vector versions leave over
+static void ConvertSpan_C(const uint8_t *s0, const uint8_t *s1, uint32_t x, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c)
+{
+	size_t step = nv12 ? 2 : 1;
+
+	for (; x < width; x += 2) {
+		uint32_t x1 = (x + 1 < width) ? x + 1 : x;
+		const uint8_t *p00 = s0 + size_t(x) * 4;
+		const uint8_t *p01 = s0 + size_t(x1) * 4;
+		const uint8_t *p10 = s1 + size_t(x) * 4;
+		const uint8_t *p11 = s1 + size_t(x1) * 4;
+
+		y0[x] = Luma_C(p00, c);
+		y0[x1] = Luma_C(p01, c);
+		if (y1) {
+			y1[x] = Luma_C(p10, c);
+			y1[x1] = Luma_C(p11, c);
+		}
+
+		int32_t b = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+		int32_t g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+		int32_t r = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+
+		size_t index = size_t(x / 2) * step;
+		u[index] = Clamp255((c.uB * b + c.uG * g + c.uR * r + c.uvRound) >> YUV_SHIFT);
+		v[index] = Clamp255((c.vB * b + c.vG * g + c.vR * r + c.uvRound) >> YUV_SHIFT);
+	}
+}
+
+static void ConvertRowPair_C(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c)
+{
+	ConvertSpan_C(s0, s1, 0, width, y0, y1, u, v, nv12, c);
+}
+
+// A pixel is split into (B, R) and (G, A) 16 bit pairs, one pmaddwd each gives B*cb + R*cr and G*cg
+static inline int32_t PackCoefs(int16_t lo, int16_t hi)
+{
+	return (int32_t)(((uint32_t)(uint16_t)hi << 16) | (uint16_t)lo);
+}
+
+#ifdef MAG_YUV_SSE2
+struct ST_YuvVectors {
+	__m128i mask;
+	__m128i two;
+	__m128i yBR, yGA, yRound;
+	__m128i uBR, uGA, vBR, vGA, uvRound;
+
+	explicit ST_YuvVectors(const ST_YuvCoefs &c)
+	{
+		mask = _mm_set1_epi32(0x00FF00FF);
+		two = _mm_set1_epi16(2);
+		yBR = _mm_set1_epi32(PackCoefs(c.yB, c.yR));
+		yGA = _mm_set1_epi32(PackCoefs(c.yG, 0));
+		yRound = _mm_set1_epi32(c.yRound);
+		uBR = _mm_set1_epi32(PackCoefs(c.uB, c.uR));
+		uGA = _mm_set1_epi32(PackCoefs(c.uG, 0));
+		vBR = _mm_set1_epi32(PackCoefs(c.vB, c.vR));
+		vGA = _mm_set1_epi32(PackCoefs(c.vG, 0));
+		uvRound = _mm_set1_epi32(c.uvRound);
+	}
+};
+
+static inline __m128i Luma4_SSE2(__m128i px, const ST_YuvVectors &k)
+{
+	__m128i br = _mm_and_si128(px, k.mask);
+	__m128i ga = _mm_and_si128(_mm_srli_epi32(px, 8), k.mask);
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(br, k.yBR), _mm_madd_epi16(ga, k.yGA));
+	return _mm_srai_epi32(_mm_add_epi32(sum, k.yRound), YUV_SHIFT);
+}
+
+static inline __m128i Luma16_SSE2(const uint8_t *s, const ST_YuvVectors &k)
+{
+	__m128i y0 = Luma4_SSE2(_mm_loadu_si128((const __m128i *)s), k);
+	__m128i y1 = Luma4_SSE2(_mm_loadu_si128((const __m128i *)s + 1), k);
+	__m128i y2 = Luma4_SSE2(_mm_loadu_si128((const __m128i *)s + 2), k);
+	__m128i y3 = Luma4_SSE2(_mm_loadu_si128((const __m128i *)s + 3), k);
+	return _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+}
+
+// Per pixel sum of the two rows, (B, R) and (G, A) as 16 bit pairs
+static inline void ColumnSums_SSE2(__m128i a, __m128i b, const ST_YuvVectors &k, __m128i &br, __m128i &ga)
+{
+	br = _mm_add_epi16(_mm_and_si128(a, k.mask), _mm_and_si128(b, k.mask));
+	ga = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(a, 8), k.mask), _mm_and_si128(_mm_srli_epi32(b, 8), k.mask));
+}
+
+// brSum/gaSum hold the 2x2 sums of 4 blocks
+static inline void Chroma4_SSE2(__m128i brSum, __m128i gaSum, const ST_YuvVectors &k, __m128i &u, __m128i &v)
+{
+	__m128i br = _mm_srli_epi16(_mm_add_epi16(brSum, k.two), 2);
+	__m128i ga = _mm_srli_epi16(_mm_add_epi16(gaSum, k.two), 2);
+	u = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(br, k.uBR), _mm_madd_epi16(ga, k.uGA)), k.uvRound), YUV_SHIFT);
+	v = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(br, k.vBR), _mm_madd_epi16(ga, k.vGA)), k.uvRound), YUV_SHIFT);
+}
+
+// u16/v16 hold 8 blocks starting at pixel x
+static inline void StoreChroma8_SSE2(__m128i u16, __m128i v16, uint8_t *u, uint8_t *v, uint32_t x, bool nv12)
+{
+	if (nv12) {
+		__m128i uv = _mm_packus_epi16(_mm_unpacklo_epi16(u16, v16), _mm_unpackhi_epi16(u16, v16));
+		_mm_storeu_si128((__m128i *)(u + x), uv);
+	} else {
+		__m128i uv = _mm_packus_epi16(u16, v16);
+		_mm_storel_epi64((__m128i *)(u + x / 2), uv);
+		_mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(uv, 8));
+	}
+}
+
+// Sums of pixel pairs end up in lanes 0 and 2, move them next to each other
+static inline __m128i PairSums_SSE2(__m128i lo, __m128i hi)
+{
+	lo = _mm_add_epi16(lo, _mm_srli_epi64(lo, 32));
+	hi = _mm_add_epi16(hi, _mm_srli_epi64(hi, 32));
+	lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+	hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+static inline uint32_t ConvertSpan_SSE2(const uint8_t *s0, const uint8_t *s1, uint32_t x, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvVectors &k)
+{
+	for (; x + 16 <= width; x += 16) {
+		const __m128i *a = (const __m128i *)(s0 + size_t(x) * 4);
+		const __m128i *b = (const __m128i *)(s1 + size_t(x) * 4);
+
+		_mm_storeu_si128((__m128i *)(y0 + x), Luma16_SSE2((const uint8_t *)a, k));
+		if (y1)
+			_mm_storeu_si128((__m128i *)(y1 + x), Luma16_SSE2((const uint8_t *)b, k));
+
+		__m128i br[4], ga[4];
+		for (int i = 0; i < 4; i++)
+			ColumnSums_SSE2(_mm_loadu_si128(a + i), _mm_loadu_si128(b + i), k, br[i], ga[i]);
+
+		__m128i u0, v0, u1, v1;
+		Chroma4_SSE2(PairSums_SSE2(br[0], br[1]), PairSums_SSE2(ga[0], ga[1]), k, u0, v0);
+		Chroma4_SSE2(PairSums_SSE2(br[2], br[3]), PairSums_SSE2(ga[2], ga[3]), k, u1, v1);
+		StoreChroma8_SSE2(_mm_packs_epi32(u0, u1), _mm_packs_epi32(v0, v1), u, v, x, nv12);
+	}
+
+	return x;
+}
+
+static void ConvertRowPair_SSE2(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c)
+{
+	ST_YuvVectors k(c);
+	uint32_t x = ConvertSpan_SSE2(s0, s1, 0, width, y0, y1, u, v, nv12, k);
+	ConvertSpan_C(s0, s1, x, width, y0, y1, u, v, nv12, c);
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+// phaddd adds the pixel pairs and packs them in one instruction
+MAG_TARGET_SSSE3 static void ConvertRowPair_SSSE3(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c)
+{
+	ST_YuvVectors k(c);
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i *a = (const __m128i *)(s0 + size_t(x) * 4);
+		const __m128i *b = (const __m128i *)(s1 + size_t(x) * 4);
+
+		_mm_storeu_si128((__m128i *)(y0 + x), Luma16_SSE2((const uint8_t *)a, k));
+		if (y1)
+			_mm_storeu_si128((__m128i *)(y1 + x), Luma16_SSE2((const uint8_t *)b, k));
+
+		__m128i br[4], ga[4];
+		for (int i = 0; i < 4; i++)
+			ColumnSums_SSE2(_mm_loadu_si128(a + i), _mm_loadu_si128(b + i), k, br[i], ga[i]);
+
+		__m128i u0, v0, u1, v1;
+		Chroma4_SSE2(_mm_hadd_epi32(br[0], br[1]), _mm_hadd_epi32(ga[0], ga[1]), k, u0, v0);
+		Chroma4_SSE2(_mm_hadd_epi32(br[2], br[3]), _mm_hadd_epi32(ga[2], ga[3]), k, u1, v1);
+		StoreChroma8_SSE2(_mm_packs_epi32(u0, u1), _mm_packs_epi32(v0, v1), u, v, x, nv12);
+	}
+
+	ConvertSpan_C(s0, s1, x, width, y0, y1, u, v, nv12, c);
+}
+
+MAG_TARGET_AVX2 static inline __m256i Luma8_AVX2(__m256i px, __m256i mask, __m256i coefBR, __m256i coefGA, __m256i round)
+{
+	__m256i br = _mm256_and_si256(px, mask);
+	__m256i ga = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+	__m256i sum = _mm256_add_epi32(_mm256_madd_epi16(br, coefBR), _mm256_madd_epi16(ga, coefGA));
+	return _mm256_srai_epi32(_mm256_add_epi32(sum, round), YUV_SHIFT);
+}
+
+MAG_TARGET_AVX2 static void ConvertRowPair_AVX2(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *y0, uint8_t *y1, uint8_t *u, uint8_t *v, bool nv12, const ST_YuvCoefs &c)
+{
+	const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+	const __m256i two = _mm256_set1_epi16(2);
+	const __m256i yBR = _mm256_set1_epi32(PackCoefs(c.yB, c.yR));
+	const __m256i yGA = _mm256_set1_epi32(PackCoefs(c.yG, 0));
+	const __m256i yRound = _mm256_set1_epi32(c.yRound);
+	const __m256i uBR = _mm256_set1_epi32(PackCoefs(c.uB, c.uR));
+	const __m256i uGA = _mm256_set1_epi32(PackCoefs(c.uG, 0));
+	const __m256i vBR = _mm256_set1_epi32(PackCoefs(c.vB, c.vR));
+	const __m256i vGA = _mm256_set1_epi32(PackCoefs(c.vG, 0));
+	const __m256i uvRound = _mm256_set1_epi32(c.uvRound);
+	// packs/packus work per 128 bit lane, this puts the 32 bit groups back in order
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	uint32_t x = 0;
+	for (; x + 32 <= width; x += 32) {
+		const __m256i *a = (const __m256i *)(s0 + size_t(x) * 4);
+		const __m256i *b = (const __m256i *)(s1 + size_t(x) * 4);
+
+		__m256i pa[4], pb[4];
+		for (int i = 0; i < 4; i++) {
+			pa[i] = _mm256_loadu_si256(a + i);
+			pb[i] = _mm256_loadu_si256(b + i);
+		}
+
+		for (int row = 0; row < 2; row++) {
+			uint8_t *dst = row ? y1 : y0;
+			if (!dst)
+				continue;
+
+			const __m256i *p = row ? pb : pa;
+			__m256i l0 = Luma8_AVX2(p[0], mask, yBR, yGA, yRound);
+			__m256i l1 = Luma8_AVX2(p[1], mask, yBR, yGA, yRound);
+			__m256i l2 = Luma8_AVX2(p[2], mask, yBR, yGA, yRound);
+			__m256i l3 = Luma8_AVX2(p[3], mask, yBR, yGA, yRound);
+			__m256i luma = _mm256_packus_epi16(_mm256_packs_epi32(l0, l1), _mm256_packs_epi32(l2, l3));
+			_mm256_storeu_si256((__m256i *)(dst + x), _mm256_permutevar8x32_epi32(luma, order));
+		}
+
+		__m256i br[4], ga[4];
+		for (int i = 0; i < 4; i++) {
+			br[i] = _mm256_add_epi16(_mm256_and_si256(pa[i], mask), _mm256_and_si256(pb[i], mask));
+			ga[i] = _mm256_add_epi16(_mm256_and_si256(_mm256_srli_epi32(pa[i], 8), mask), _mm256_and_si256(_mm256_srli_epi32(pb[i], 8), mask));
+		}
+
+		__m256i cu[2], cv[2];
+		for (int i = 0; i < 2; i++) {
+			__m256i brAvg = _mm256_srli_epi16(_mm256_add_epi16(_mm256_hadd_epi32(br[2 * i], br[2 * i + 1]), two), 2);
+			__m256i gaAvg = _mm256_srli_epi16(_mm256_add_epi16(_mm256_hadd_epi32(ga[2 * i], ga[2 * i + 1]), two), 2);
+			cu[i] = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(brAvg, uBR), _mm256_madd_epi16(gaAvg, uGA)), uvRound);
+			cv[i] = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(brAvg, vBR), _mm256_madd_epi16(gaAvg, vGA)), uvRound);
+			cu[i] = _mm256_srai_epi32(cu[i], YUV_SHIFT);
+			cv[i] = _mm256_srai_epi32(cv[i], YUV_SHIFT);
+		}
+
+		__m256i u16 = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(cu[0], cu[1]), order);
+		__m256i v16 = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(cv[0], cv[1]), order);
+		if (nv12) {
+			__m256i uv = _mm256_packus_epi16(_mm256_unpacklo_epi16(u16, v16), _mm256_unpackhi_epi16(u16, v16));
+			_mm256_storeu_si256((__m256i *)(u + x), uv);
+		} else {
+			__m256i uv = _mm256_permute4x64_epi64(_mm256_packus_epi16(u16, v16), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(uv));
+			_mm_storeu_si128((__m128i *)(v + x / 2), _mm256_extracti128_si256(uv, 1));
+		}
+	}
+
+	ST_YuvVectors k(c);
+	x = ConvertSpan_SSE2(s0, s1, x, width, y0, y1, u, v, nv12, k);
+	ConvertSpan_C(s0, s1, x, width, y0, y1, u, v, nv12, c);
+}
+#endif
+
+static Kernel<ConvertRowPair_t> s_ConvertRowPair("ConvertRowPair", {
+	{MAG_CPU_SCALAR, ConvertRowPair_C},
+#ifdef MAG_YUV_SSE2
+	{MAG_CPU_SSE2, ConvertRowPair_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_SSSE3, ConvertRowPair_SSSE3},
+	{MAG_CPU_AVX2, ConvertRowPair_AVX2},
+#endif
+});
+
+void ConvertBGRAToYuv(const uint8_t *src, int32_t srcPitch, uint32_t width, uint32_t height, uint32_t rowBegin, uint32_t rowEnd, MagYuvFormat format, uint8_t *const planes[3],
+		      const int32_t pitches[3], const ST_YuvCoefs &coefs)
+{
+	ConvertRowPair_t impl = s_ConvertRowPair.Get();
+
+	assert(rowBegin % 2 == 0);
+	assert(format != MAG_YUV_NONE);
+
+	bool nv12 = (format == MAG_YUV_NV12);
+	if (rowEnd > height)
+		rowEnd = height;
+
+	// rows are converted in pairs, an odd last row is paired with itself
+	for (uint32_t y = rowBegin; y < rowEnd; y += 2) {
+		bool bPair = (y + 1 < height);
+		const uint8_t *s0 = src + size_t(srcPitch) * y;
+		const uint8_t *s1 = bPair ? s0 + srcPitch : s0;
+		uint8_t *y0 = planes[0] + size_t(pitches[0]) * y;
+		uint8_t *y1 = bPair ? y0 + pitches[0] : nullptr;
+		uint8_t *u = planes[1] + size_t(pitches[1]) * (y / 2);
+		uint8_t *v = nv12 ? u + 1 : planes[2] + size_t(pitches[2]) * (y / 2);
+
+		impl(s0, s1, width, y0, y1, u, v, nv12, coefs);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+BGRA -> NV12 / I420 颜色转换
+所有版本都使用 14 位定点系数 (pmaddwd)，标量、SSE2、SSSE3、AVX2 的结果逐位一致。
+色度取 2x2 像素的平均值，奇数宽高时复制最后一列/行。
+可以按行带 (偶数起始行) 分段调用，不同的行带之间没有共享的输出，可以并行处理。
+*/
+
+enum MagYuvFormat {
+	MAG_YUV_NONE = 0,
+	MAG_YUV_NV12, // Y plane + interleaved UV plane
+	MAG_YUV_I420, // Y plane + U plane + V plane
+};
+
+enum MagColorMatrix {
+	MAG_MATRIX_BT601 = 0,
+	MAG_MATRIX_BT709,
+};
+
+enum MagColorRange {
+	MAG_RANGE_LIMITED = 0, // Y 16-235, UV 16-240
+	MAG_RANGE_FULL,
+};
+
+struct ST_YuvCoefs {
+	int16_t yB, yG, yR;
+	int16_t uB, uG, uR;
+	int16_t vB, vG, vR;
+	int32_t yRound;  // (offset << 14) + rounding
+	int32_t uvRound; // (128 << 14) + rounding
+};
+
+void CalcYuvCoefs(MagColorMatrix matrix, MagColorRange range, ST_YuvCoefs &coefs);
+
+// Fills the offset and pitch of every plane (every plane starts on a cache line), returns the total bytes
+size_t CalcYuvLayout(MagYuvFormat format, uint32_t width, uint32_t height, size_t offsets[3], int32_t pitches[3]);
+
+// Converts the rows [rowBegin, rowEnd) of a BGRA plane in pairs, rowBegin must be even and an odd rowEnd includes the next row.
+// For NV12 planes[2] is not used.
+void ConvertBGRAToYuv(const uint8_t *src, int32_t srcPitch, uint32_t width, uint32_t height, uint32_t rowBegin, uint32_t rowEnd, MagYuvFormat format, uint8_t *const planes[3],
+		      const int32_t pitches[3], const ST_YuvCoefs &coefs);
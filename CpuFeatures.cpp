@@ -0,0 +1,70 @@
+#include "CpuFeatures.h"
+
+#ifdef MAG_ARCH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef MAG_ARCH_X86
+static void CpuId(int leaf, int subLeaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int *)regs, leaf, subLeaf);
+#else
+	__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long XGetBV()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+static ST_CpuFeatures DetectCpuFeatures()
+{
+	ST_CpuFeatures ret;
+
+#ifdef MAG_ARCH_X86
+	unsigned int regs[4] = {0};
+	CpuId(0, 0, regs);
+	int maxLeaf = (int)regs[0];
+	if (maxLeaf < 1)
+		return ret;
+
+	CpuId(1, 0, regs);
+	ret.sse2 = (regs[3] & (1u << 26)) != 0;
+	ret.ssse3 = (regs[2] & (1u << 9)) != 0;
+	ret.sse41 = (regs[2] & (1u << 19)) != 0;
+
+	// the OS must save the ymm/zmm state as well
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avx = (regs[2] & (1u << 28)) != 0;
+	unsigned long long xcr0 = osxsave ? XGetBV() : 0;
+	bool ymm = (xcr0 & 0x6) == 0x6;
+	bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+	if (maxLeaf >= 7) {
+		CpuId(7, 0, regs);
+		ret.avx2 = avx && ymm && (regs[1] & (1u << 5)) != 0;
+		ret.avx512bw = zmm && (regs[1] & (1u << 16)) != 0 && (regs[1] & (1u << 30)) != 0;
+	}
+#endif
+
+	return ret;
+}
+
+const ST_CpuFeatures &GetCpuFeatures()
+{
+	static const ST_CpuFeatures features = DetectCpuFeatures();
+	return features;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+CPU 指令集检测，结果在第一次调用时缓存
+*/
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MAG_ARCH_X86 1
+#endif
+
+// Functions using SSSE3/AVX2/AVX-512 intrinsics must be marked on GCC/Clang, MSVC accepts them anywhere
+#if defined(MAG_ARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MAG_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define MAG_TARGET_AVX2 __attribute__((target("avx2")))
+#define MAG_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define MAG_TARGET_SSSE3
+#define MAG_TARGET_AVX2
+#define MAG_TARGET_AVX512
+#endif
+
+struct ST_CpuFeatures {
+	bool sse2 = false;
+	bool ssse3 = false;
+	bool sse41 = false;
+	bool avx2 = false;
+	bool avx512bw = false;
+};
+
+const ST_CpuFeatures &GetCpuFeatures();
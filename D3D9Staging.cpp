@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "D3D9Staging.h"
+#include <assert.h>
+
+bool D3D9StagingDevice::Open(IDirect3DDevice9Ex *device, D3DFORMAT format, UINT width, UINT height)
+{
+	Close();
+
+	m_pDevice = device;
+	m_Format = format;
+	m_uWidth = width;
+	m_uHeight = height;
+	return true;
+}
+
+void D3D9StagingDevice::Close()
+{
+	ReleaseSlots();
+	m_pDevice = nullptr;
+	m_Format = D3DFMT_UNKNOWN;
+	m_uWidth = 0;
+	m_uHeight = 0;
+	m_nPitch = 0;
+}
+
+bool D3D9StagingDevice::CreateSlots(uint32_t count)
+{
+	assert(m_pDevice && count);
+	ReleaseSlots();
+	if (!m_pDevice)
+		return false;
+
+	m_vSurfaces.resize(count);
+	m_vQueries.resize(count);
+	for (uint32_t i = 0; i < count; i++) {
+		HRESULT hr = m_pDevice->CreateOffscreenPlainSurface(m_uWidth, m_uHeight, m_Format, D3DPOOL_SYSTEMMEM, m_vSurfaces[i].Assign(), nullptr);
+		if (FAILED(hr))
+			return false;
+
+		// without a query Lock relies on LockRect to wait for the copy
+		m_pDevice->CreateQuery(D3DQUERYTYPE_EVENT, m_vQueries[i].Assign());
+	}
+
+	// same size and format, every slot has the same pitch
+	D3DLOCKED_RECT rect;
+	HRESULT hr = m_vSurfaces[0]->LockRect(&rect, nullptr, D3DLOCK_READONLY);
+	if (FAILED(hr))
+		return false;
+
+	m_nPitch = rect.Pitch;
+	m_vSurfaces[0]->UnlockRect();
+	return true;
+}
+
+void D3D9StagingDevice::ReleaseSlots()
+{
+	m_vSurfaces.clear();
+	m_vQueries.clear();
+}
+
+bool D3D9StagingDevice::Copy(uint32_t slot)
+{
+	assert(slot < m_vSurfaces.size());
+	ComPtr<IDirect3DSurface9> bkBuffer;
+	HRESULT hr = m_pDevice->GetRenderTarget(0, bkBuffer.Assign());
+	if (FAILED(hr))
+		return false;
+
+	// queued behind the rendering of this present, the slot is not touched by the CPU until its query signaled
+	hr = m_pDevice->GetRenderTargetData(bkBuffer, m_vSurfaces[slot]);
+	if (FAILED(hr))
+		return false;
+
+	if (m_vQueries[slot])
+		m_vQueries[slot]->Issue(D3DISSUE_END);
+
+	return true;
+}
+
+bool D3D9StagingDevice::IsReady(uint32_t slot)
+{
+	if (!m_vQueries[slot])
+		return true;
+
+	// no D3DGETDATA_FLUSH, only asks
+	return m_vQueries[slot]->GetData(nullptr, 0, 0) != S_FALSE;
+}
+
+bool D3D9StagingDevice::Lock(uint32_t slot, ST_StagingLock &lock)
+{
+	assert(slot < m_vSurfaces.size());
+	if (m_vQueries[slot]) {
+		// only waits if the copy has not finished yet, an error (device lost) falls through to LockRect
+		while (m_vQueries[slot]->GetData(nullptr, 0, D3DGETDATA_FLUSH) == S_FALSE)
+			SwitchToThread();
+	}
+
+	D3DLOCKED_RECT rect;
+	HRESULT hr = m_vSurfaces[slot]->LockRect(&rect, nullptr, D3DLOCK_READONLY);
+	if (FAILED(hr))
+		return false;
+
+	assert(rect.Pitch == m_nPitch);
+	lock.bits = (const uint8_t *)rect.pBits;
+	lock.pitch = rect.Pitch;
+	return true;
+}
+
+void D3D9StagingDevice::Unlock(uint32_t slot)
+{
+	m_vSurfaces[slot]->UnlockRect();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <d3d9.h>
+#include "ComPtr.hpp"
+#include "StagingRing.h"
+
+/*
+StagingRing 的 D3D9 实现
+每个槽位有自己的系统内存表面和事件查询。Copy 用 GetRenderTargetData 把后台缓冲区复制到该槽位的表面并插入查询，不等待 GPU；
+Lock 时 (latency 次 Present 之后) 查询通常早已完成，LockRect 只锁定该槽位自己的表面，不再有同步的复制。
+只有一个槽位时 Copy 之后立刻 Lock，与原来相同。
+*/
+
+class D3D9StagingDevice : public IStagingDevice {
+public:
+	// Size and format of the back buffer, the surfaces are created by CreateSlots
+	bool Open(IDirect3DDevice9Ex *device, D3DFORMAT format, UINT width, UINT height);
+	void Close();
+	// Of every slot, known once the slots exist
+	INT GetPitch() const { return m_nPitch; }
+
+	bool CreateSlots(uint32_t count) override;
+	void ReleaseSlots() override;
+	bool Copy(uint32_t slot) override;
+	bool IsReady(uint32_t slot) override;
+	bool Lock(uint32_t slot, ST_StagingLock &lock) override;
+	void Unlock(uint32_t slot) override;
+
+private:
+	IDirect3DDevice9Ex *m_pDevice = nullptr; /* do not release */
+	D3DFORMAT m_Format = D3DFMT_UNKNOWN;
+	UINT m_uWidth = 0;
+	UINT m_uHeight = 0;
+	INT m_nPitch = 0;
+
+	std::vector<ComPtr<IDirect3DSurface9>> m_vSurfaces; // system memory, one per slot
+	std::vector<ComPtr<IDirect3DQuery9>> m_vQueries;    // signaled when the copy into the slot finished, may be null
+};
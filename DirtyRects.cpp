@@ -0,0 +1,125 @@
+#include "DirtyRects.h"
+#include "FrameCopy.h"
+
+static inline bool IsEmpty(const ST_DirtyRect &rc)
+{
+	return rc.right <= rc.left || rc.bottom <= rc.top;
+}
+
+static inline bool Overlaps(const ST_DirtyRect &a, const ST_DirtyRect &b)
+{
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+static inline ST_DirtyRect Union(const ST_DirtyRect &a, const ST_DirtyRect &b)
+{
+	ST_DirtyRect ret;
+	ret.left = a.left < b.left ? a.left : b.left;
+	ret.top = a.top < b.top ? a.top : b.top;
+	ret.right = a.right > b.right ? a.right : b.right;
+	ret.bottom = a.bottom > b.bottom ? a.bottom : b.bottom;
+	return ret;
+}
+
+static inline int64_t Area(const ST_DirtyRect &rc)
+{
+	return int64_t(rc.right - rc.left) * int64_t(rc.bottom - rc.top);
+}
+
+static inline void RemoveAt(ST_DirtyRectList &list, uint32_t index)
+{
+	list.rects[index] = list.rects[list.count - 1];
+	--list.count;
+}
+
+void ClearDirtyRects(ST_DirtyRectList &list)
+{
+	list.count = 0;
+}
+
+void SetFullDirty(ST_DirtyRectList &list, int32_t width, int32_t height)
+{
+	list.count = 0;
+	if (width > 0 && height > 0) {
+		list.rects[0] = ST_DirtyRect{0, 0, width, height};
+		list.count = 1;
+	}
+}
+
+void AddDirtyRect(ST_DirtyRectList &list, ST_DirtyRect rc, int32_t width, int32_t height)
+{
+	if (rc.left < 0)
+		rc.left = 0;
+	if (rc.top < 0)
+		rc.top = 0;
+	if (rc.right > width)
+		rc.right = width;
+	if (rc.bottom > height)
+		rc.bottom = height;
+
+	if (IsEmpty(rc))
+		return;
+
+	for (;;) {
+		bool merged = false;
+		for (uint32_t i = 0; i < list.count; i++) {
+			if (Overlaps(list.rects[i], rc)) {
+				rc = Union(list.rects[i], rc);
+				RemoveAt(list, i);
+				merged = true;
+				break;
+			}
+		}
+
+		if (merged)
+			continue;
+
+		if (list.count < MAG_MAX_DIRTY_RECTS)
+			break;
+
+		// list is full: fold rc into the rect whose bounding box grows the least
+		uint32_t best = 0;
+		int64_t bestCost = INT64_MAX;
+		for (uint32_t i = 0; i < list.count; i++) {
+			int64_t cost = Area(Union(list.rects[i], rc)) - Area(list.rects[i]);
+			if (cost < bestCost) {
+				bestCost = cost;
+				best = i;
+			}
+		}
+
+		rc = Union(list.rects[best], rc);
+		RemoveAt(list, best);
+	}
+
+	list.rects[list.count++] = rc;
+}
+
+void MergeDirtyRects(ST_DirtyRectList &list, const ST_DirtyRectList &other, int32_t width, int32_t height)
+{
+	for (uint32_t i = 0; i < other.count; i++)
+		AddDirtyRect(list, other.rects[i], width, height);
+}
+
+void ScaleDirtyRects(ST_DirtyRectList &list, const ST_DirtyRectList &src, int32_t srcWidth, int32_t srcHeight, int32_t dstWidth, int32_t dstHeight, int32_t margin)
+{
+	ClearDirtyRects(list);
+	for (uint32_t i = 0; i < src.count; i++) {
+		const ST_DirtyRect &rc = src.rects[i];
+		ST_DirtyRect item;
+		item.left = (int32_t)(int64_t(rc.left) * dstWidth / srcWidth) - margin;
+		item.top = (int32_t)(int64_t(rc.top) * dstHeight / srcHeight) - margin;
+		item.right = (int32_t)((int64_t(rc.right) * dstWidth + srcWidth - 1) / srcWidth) + margin;
+		item.bottom = (int32_t)((int64_t(rc.bottom) * dstHeight + srcHeight - 1) / srcHeight) + margin;
+		AddDirtyRect(list, item, dstWidth, dstHeight);
+	}
+}
+
+void CopyDirtyRects32(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, const ST_DirtyRectList &list)
+{
+	for (uint32_t i = 0; i < list.count; i++) {
+		const ST_DirtyRect &rc = list.rects[i];
+		size_t x = size_t(rc.left) * 4;
+		CopyPlane(dst + size_t(dstPitch) * rc.top + x, dstPitch, src + size_t(srcPitch) * rc.top + x, srcPitch, uint32_t(rc.right - rc.left) * 4, uint32_t(rc.bottom - rc.top));
+	}
+}
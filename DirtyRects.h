@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+
+/*
+脏矩形列表
+PresentEx 的 dirty_region 被裁剪到帧范围后合并成数量有限的矩形，
+超过 MAG_MAX_DIRTY_RECTS 时合并面积增长最小的一对，保证不漏掉任何改变的区域。
+*/
+
+#define MAG_MAX_DIRTY_RECTS 16
+
+struct ST_DirtyRect {
+	int32_t left;
+	int32_t top;
+	int32_t right;
+	int32_t bottom;
+};
+
+struct ST_DirtyRectList {
+	uint32_t count = 0;
+	ST_DirtyRect rects[MAG_MAX_DIRTY_RECTS];
+};
+
+void ClearDirtyRects(ST_DirtyRectList &list);
+void SetFullDirty(ST_DirtyRectList &list, int32_t width, int32_t height);
+
+// rc is clipped to (0, 0, width, height) and merged with any rect it overlaps
+void AddDirtyRect(ST_DirtyRectList &list, ST_DirtyRect rc, int32_t width, int32_t height);
+void MergeDirtyRects(ST_DirtyRectList &list, const ST_DirtyRectList &other, int32_t width, int32_t height);
+
+// Maps the rects of a srcWidth x srcHeight frame onto a scaled frame, rounded outwards and grown by margin for the filter support
+void ScaleDirtyRects(ST_DirtyRectList &list, const ST_DirtyRectList &src, int32_t srcWidth, int32_t srcHeight, int32_t dstWidth, int32_t dstHeight, int32_t margin);
+
+// Copies only the listed rects of a 32bpp plane, both planes use frame coordinates
+void CopyDirtyRects32(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, const ST_DirtyRectList &list);
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#define MAG_CACHE_LINE 64
+#define MAG_PAGE_SIZE 4096
+
+// How the pitch of a captured frame is derived from the locked surface
+enum MagPitchPolicy {
+	MAG_PITCH_SOURCE = 0,  // keep the pitch of the locked surface, frame is one memmove
+	MAG_PITCH_CACHE_LINE,  // row bytes rounded up to 64, every row starts on a cache line
+	MAG_PITCH_NO_4K_ALIAS, // like MAG_PITCH_CACHE_LINE, plus one cache line if the pitch is a multiple of 4K
+	MAG_PITCH_PACKED,      // pitch equals row bytes
+};
+
+inline size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// alignment must be a power of two and a multiple of sizeof(void *)
+inline uint8_t *AlignedMalloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+	return (uint8_t *)_aligned_malloc(size, alignment);
+#else
+	void *ret = nullptr;
+	if (posix_memalign(&ret, alignment, size) != 0)
+		return nullptr;
+	return (uint8_t *)ret;
+#endif
+}
+
+inline void AlignedFree(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+inline int32_t CalcFramePitch(uint32_t rowBytes, int32_t srcPitch, MagPitchPolicy policy)
+{
+	switch (policy) {
+	case MAG_PITCH_SOURCE:
+		return srcPitch;
+
+	case MAG_PITCH_PACKED:
+		return (int32_t)rowBytes;
+
+	case MAG_PITCH_NO_4K_ALIAS: {
+		size_t pitch = AlignUp(rowBytes, MAG_CACHE_LINE);
+		if (pitch % MAG_PAGE_SIZE == 0)
+			pitch += MAG_CACHE_LINE;
+		return (int32_t)pitch;
+	}
+
+	case MAG_PITCH_CACHE_LINE:
+	default:
+		return (int32_t)AlignUp(rowBytes, MAG_CACHE_LINE);
+	}
+}
+
+// Largest power of two (up to limit) that every row start of the plane is aligned to
+inline uint32_t CalcRowAlignment(const void *data, int32_t pitch, uint32_t limit = MAG_PAGE_SIZE)
+{
+	uintptr_t bits = (uintptr_t)data | (uintptr_t)(uint32_t)pitch | limit;
+	return (uint32_t)(bits & (~bits + 1));
+}
@@ -0,0 +1,162 @@
+#include "FrameCopy.h"
+#include "CpuFeatures.h"
+#include "KernelDispatch.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAG_COPY_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MAG_ARCH_X86
+#include <immintrin.h>
+#endif
+
+#define STREAM_PREFETCH 1024 // bytes ahead of the loads, T0: prefetchnta measured 35% slower on a cold source
+
+static void CopyPlane_C(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	if (dstPitch == srcPitch && uint32_t(srcPitch) == rowBytes) {
+		// rows are back to back, one contiguous block. Any gap between rows may hold pixels of a wider frame
+		memcpy(dst, src, size_t(srcPitch) * (rows - 1) + rowBytes);
+		return;
+	}
+
+	for (uint32_t i = 0; i < rows; i++) {
+		memcpy(dst, src, rowBytes);
+		dst += dstPitch;
+		src += srcPitch;
+	}
+}
+
+typedef void (*CopyPlane_t)(uint8_t *, int32_t, const uint8_t *, int32_t, uint32_t, uint32_t);
+
+// memcpy of the CRT already picks the widest moves the CPU has
+static Kernel<CopyPlane_t> s_CopyPlane("CopyPlane", {
+	{MAG_CPU_SCALAR, CopyPlane_C},
+});
+
+#ifdef MAG_COPY_SSE2
+// Unaligned head and tail go through memcpy, everything in between is 16 byte aligned streaming stores
+static void StreamRow_SSE2(uint8_t *dst, const uint8_t *src, size_t bytes)
+{
+	size_t head = (16 - ((uintptr_t)dst & 15)) & 15;
+	if (head > bytes)
+		head = bytes;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+
+	for (; bytes >= 64; bytes -= 64) {
+		_mm_prefetch((const char *)src + STREAM_PREFETCH, _MM_HINT_T0);
+		__m128i a = _mm_loadu_si128((const __m128i *)src);
+		__m128i b = _mm_loadu_si128((const __m128i *)src + 1);
+		__m128i c = _mm_loadu_si128((const __m128i *)src + 2);
+		__m128i d = _mm_loadu_si128((const __m128i *)src + 3);
+		_mm_stream_si128((__m128i *)dst, a);
+		_mm_stream_si128((__m128i *)dst + 1, b);
+		_mm_stream_si128((__m128i *)dst + 2, c);
+		_mm_stream_si128((__m128i *)dst + 3, d);
+		src += 64;
+		dst += 64;
+	}
+
+	for (; bytes >= 16; bytes -= 16) {
+		_mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+		src += 16;
+		dst += 16;
+	}
+
+	memcpy(dst, src, bytes);
+}
+
+static void StreamPlane_SSE2(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	if (dstPitch == srcPitch && uint32_t(srcPitch) == rowBytes) {
+		StreamRow_SSE2(dst, src, size_t(srcPitch) * (rows - 1) + rowBytes); // same block as CopyPlane_C
+	} else {
+		for (uint32_t i = 0; i < rows; i++)
+			StreamRow_SSE2(dst + size_t(dstPitch) * i, src + size_t(srcPitch) * i, rowBytes);
+	}
+
+	_mm_sfence(); // streaming stores are weakly ordered, the frame is published right after
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+MAG_TARGET_AVX2 static void StreamRow_AVX2(uint8_t *dst, const uint8_t *src, size_t bytes)
+{
+	size_t head = (32 - ((uintptr_t)dst & 31)) & 31;
+	if (head > bytes)
+		head = bytes;
+
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	bytes -= head;
+
+	for (; bytes >= 128; bytes -= 128) {
+		_mm_prefetch((const char *)src + STREAM_PREFETCH, _MM_HINT_T0);
+		_mm_prefetch((const char *)src + STREAM_PREFETCH + 64, _MM_HINT_T0);
+		__m256i a = _mm256_loadu_si256((const __m256i *)src);
+		__m256i b = _mm256_loadu_si256((const __m256i *)src + 1);
+		__m256i c = _mm256_loadu_si256((const __m256i *)src + 2);
+		__m256i d = _mm256_loadu_si256((const __m256i *)src + 3);
+		_mm256_stream_si256((__m256i *)dst, a);
+		_mm256_stream_si256((__m256i *)dst + 1, b);
+		_mm256_stream_si256((__m256i *)dst + 2, c);
+		_mm256_stream_si256((__m256i *)dst + 3, d);
+		src += 128;
+		dst += 128;
+	}
+
+	for (; bytes >= 32; bytes -= 32) {
+		_mm256_stream_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+		src += 32;
+		dst += 32;
+	}
+
+	memcpy(dst, src, bytes);
+}
+
+MAG_TARGET_AVX2 static void StreamPlane_AVX2(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	if (dstPitch == srcPitch && uint32_t(srcPitch) == rowBytes) {
+		StreamRow_AVX2(dst, src, size_t(srcPitch) * (rows - 1) + rowBytes); // same block as CopyPlane_C
+	} else {
+		for (uint32_t i = 0; i < rows; i++)
+			StreamRow_AVX2(dst + size_t(dstPitch) * i, src + size_t(srcPitch) * i, rowBytes);
+	}
+
+	_mm_sfence();
+}
+#endif
+
+// Without SSE2 there are no streaming stores, the scalar level is a plain copy
+static Kernel<CopyPlane_t> s_StreamPlane("StreamPlane", {
+	{MAG_CPU_SCALAR, CopyPlane_C},
+#ifdef MAG_COPY_SSE2
+	{MAG_CPU_SSE2, StreamPlane_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, StreamPlane_AVX2},
+#endif
+});
+
+void CopyPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	if (!rows || !rowBytes)
+		return;
+
+	s_CopyPlane.Get()(dst, dstPitch, src, srcPitch, rowBytes, rows);
+}
+
+void StreamPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	if (!rows || !rowBytes)
+		return;
+
+	s_StreamPlane.Get()(dst, dstPitch, src, srcPitch, rowBytes, rows);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+平台无关的像素拷贝
+从加锁的 surface (任意 pitch) 拷贝一个子矩形到帧缓冲区，只访问需要的行和列。
+StreamPlane 使用非临时 (non-temporal) 存储并预取源数据，4K 以上的帧拷贝不会把消费者线程的工作集挤出末级缓存，
+代价是之后读取这一帧的阶段要从内存读取。
+*/
+
+enum MagCopyMode {
+	MAG_COPY_AUTO = 0,  // streaming for frames of at least MAG_STREAM_COPY_MIN bytes that nothing reads again on the capture thread
+	MAG_COPY_TEMPORAL,  // memcpy, the frame stays in cache
+	MAG_COPY_STREAMING, // non-temporal stores
+};
+
+#define MAG_STREAM_COPY_MIN (16 << 20) // 4K BGRA is 33 MB, 1080p is 8 MB
+
+// Copies rows * rowBytes bytes between two pitched planes, the bytes between the rows of dst are left untouched
+void CopyPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows);
+
+// Same result as CopyPlane without keeping dst in the cache, the stores are fenced before returning
+void StreamPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows);
@@ -0,0 +1,449 @@
+#include "FrameHash.h"
+#include "CpuFeatures.h"
+#include "KernelDispatch.h"
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAG_HASH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MAG_ARCH_X86
+#include <immintrin.h>
+#endif
+
+#define HASH_STRIPE_LEN 64
+#define HASH_SECRET_LEN 192
+#define HASH_STRIPES_PER_BLOCK ((HASH_SECRET_LEN - HASH_STRIPE_LEN) / 8)
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+
+struct ST_HashSecret {
+	uint8_t bytes[HASH_SECRET_LEN];
+
+	ST_HashSecret()
+	{
+		// splitmix64, fixed seed so every build produces the same hashes
+		uint64_t seed = PRIME64_2;
+		for (size_t i = 0; i < HASH_SECRET_LEN; i += 8) {
+			uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+			z ^= z >> 31;
+			memcpy(bytes + i, &z, 8);
+		}
+	}
+};
+
+static const ST_HashSecret s_secret;
+
+static inline uint64_t Read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t Mul128Fold64(uint64_t lhs, uint64_t rhs)
+{
+	uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+	uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+	uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+	uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+
+	uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+	return upper ^ lower;
+}
+
+static inline void AccumulateScalar(uint64_t *acc, const uint8_t *input, const uint8_t *secret)
+{
+	for (int i = 0; i < 8; i++) {
+		uint64_t data = Read64(input + 8 * i);
+		uint64_t key = data ^ Read64(secret + 8 * i);
+		acc[i ^ 1] += data;
+		acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+	}
+}
+
+static inline void ScrambleScalar(uint64_t *acc, const uint8_t *secret)
+{
+	for (int i = 0; i < 8; i++) {
+		uint64_t v = acc[i];
+		v ^= v >> 47;
+		v ^= Read64(secret + 8 * i);
+		acc[i] = v * PRIME32_1;
+	}
+}
+
+#ifdef MAG_HASH_SSE2
+static inline void AccumulateSSE2(uint64_t *acc, const uint8_t *input, const uint8_t *secret)
+{
+	__m128i *xacc = (__m128i *)acc;
+	for (int i = 0; i < 4; i++) {
+		__m128i data = _mm_loadu_si128((const __m128i *)input + i);
+		__m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)secret + i));
+		__m128i keyHi = _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i product = _mm_mul_epu32(key, keyHi);
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		__m128i sum = _mm_add_epi64(_mm_loadu_si128(xacc + i), swapped);
+		_mm_storeu_si128(xacc + i, _mm_add_epi64(product, sum));
+	}
+}
+
+static inline void ScrambleSSE2(uint64_t *acc, const uint8_t *secret)
+{
+	__m128i *xacc = (__m128i *)acc;
+	const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+	for (int i = 0; i < 4; i++) {
+		__m128i v = _mm_loadu_si128(xacc + i);
+		v = _mm_xor_si128(v, _mm_srli_epi64(v, 47));
+		v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)secret + i));
+		__m128i hi = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 0, 1));
+		__m128i productLo = _mm_mul_epu32(v, prime);
+		__m128i productHi = _mm_mul_epu32(hi, prime);
+		_mm_storeu_si128(xacc + i, _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32)));
+	}
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+MAG_TARGET_AVX2 static inline __m256i AccumulateAVX2(__m256i acc, __m256i data, const uint8_t *secret)
+{
+	__m256i key = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *)secret));
+	__m256i keyHi = _mm256_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1));
+	__m256i product = _mm256_mul_epu32(key, keyHi);
+	__m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+	return _mm256_add_epi64(product, _mm256_add_epi64(acc, swapped));
+}
+
+MAG_TARGET_AVX2 static inline __m256i ScrambleAVX2(__m256i acc, const uint8_t *secret)
+{
+	const __m256i prime = _mm256_set1_epi32((int)PRIME32_1);
+	__m256i v = _mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47));
+	v = _mm256_xor_si256(v, _mm256_loadu_si256((const __m256i *)secret));
+	__m256i hi = _mm256_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 0, 1));
+	__m256i productLo = _mm256_mul_epu32(v, prime);
+	__m256i productHi = _mm256_mul_epu32(hi, prime);
+	return _mm256_add_epi64(productLo, _mm256_slli_epi64(productHi, 32));
+}
+#endif
+
+static inline void HashStripeScalar(ST_HashState &state, const uint8_t *input)
+{
+	AccumulateScalar(state.acc, input, s_secret.bytes + state.stripes * 8);
+	if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+		state.stripes = 0;
+		ScrambleScalar(state.acc, s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN);
+	}
+}
+
+// The stripe of the SSE2 and AVX2 variants, the scalar ones stay with HashStripeScalar
+static inline void HashStripe(ST_HashState &state, const uint8_t *input)
+{
+#ifdef MAG_HASH_SSE2
+	AccumulateSSE2(state.acc, input, s_secret.bytes + state.stripes * 8);
+	if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+		state.stripes = 0;
+		ScrambleSSE2(state.acc, s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN);
+	}
+#else
+	HashStripeScalar(state, input);
+#endif
+}
+
+void HashInit(ST_HashState &state)
+{
+	state.acc[0] = PRIME32_1;
+	state.acc[1] = PRIME64_1;
+	state.acc[2] = PRIME64_2;
+	state.acc[3] = 0x165667B19E3779F9ULL;
+	state.acc[4] = 0x85EBCA77C2B2AE63ULL;
+	state.acc[5] = 0x85EBCA77U;
+	state.acc[6] = 0x27D4EB2F165667C5ULL;
+	state.acc[7] = 0xC2B2AE3DU;
+	state.stripes = 0;
+	state.length = 0;
+}
+
+static inline void HashTailScalar(ST_HashState &state, const uint8_t *data, size_t bytes)
+{
+	uint8_t tail[HASH_STRIPE_LEN] = {0};
+	memcpy(tail, data, bytes);
+	HashStripeScalar(state, tail);
+}
+
+static inline void HashTail(ST_HashState &state, const uint8_t *data, size_t bytes)
+{
+	uint8_t tail[HASH_STRIPE_LEN] = {0};
+	memcpy(tail, data, bytes);
+	HashStripe(state, tail);
+}
+
+static void HashRow_C(ST_HashState &state, const uint8_t *data, size_t bytes)
+{
+	const uint8_t *scramble = s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN;
+	state.length += bytes;
+
+	while (bytes >= HASH_STRIPE_LEN) {
+		AccumulateScalar(state.acc, data, s_secret.bytes + state.stripes * 8);
+		if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+			state.stripes = 0;
+			ScrambleScalar(state.acc, scramble);
+		}
+
+		data += HASH_STRIPE_LEN;
+		bytes -= HASH_STRIPE_LEN;
+	}
+
+	if (bytes)
+		HashTailScalar(state, data, bytes);
+}
+
+#ifdef MAG_HASH_SSE2
+static void HashRow_SSE2(ST_HashState &state, const uint8_t *data, size_t bytes)
+{
+	state.length += bytes;
+
+	while (bytes >= HASH_STRIPE_LEN) {
+		HashStripe(state, data);
+		data += HASH_STRIPE_LEN;
+		bytes -= HASH_STRIPE_LEN;
+	}
+
+	if (bytes)
+		HashTail(state, data, bytes);
+}
+#endif
+
+typedef void (*HashRow_t)(ST_HashState &, const uint8_t *, size_t);
+
+static Kernel<HashRow_t> s_HashRow("HashRow", {
+	{MAG_CPU_SCALAR, HashRow_C},
+#ifdef MAG_HASH_SSE2
+	{MAG_CPU_SSE2, HashRow_SSE2},
+#endif
+});
+
+void HashRow(ST_HashState &state, const uint8_t *data, size_t bytes)
+{
+	s_HashRow.Get()(state, data, bytes);
+}
+
+uint64_t HashFinal(const ST_HashState &state)
+{
+	uint64_t h = state.length * PRIME64_1;
+	for (int i = 0; i < 4; i++)
+		h += Mul128Fold64(state.acc[2 * i] ^ Read64(s_secret.bytes + 11 + 16 * i), state.acc[2 * i + 1] ^ Read64(s_secret.bytes + 19 + 16 * i));
+
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t HashPlane(const uint8_t *data, int32_t pitch, uint32_t rowBytes, uint32_t rows)
+{
+	ST_HashState state;
+	HashInit(state);
+
+	for (uint32_t y = 0; y < rows; y++)
+		HashRow(state, data + size_t(pitch) * y, rowBytes);
+
+	return HashFinal(state);
+}
+
+void HashTileBand32(const uint8_t *data, int32_t pitch, uint32_t width, uint32_t rows, uint32_t tileSize, uint64_t *hashes)
+{
+	uint32_t tilesX = (width + tileSize - 1) / tileSize;
+
+	for (uint32_t tx = 0; tx < tilesX; tx++) {
+		uint32_t x = tx * tileSize;
+		uint32_t cx = (width - x < tileSize) ? (width - x) : tileSize;
+
+		// tile by tile, the band itself stays in cache
+		hashes[tx] = HashPlane(data + size_t(x) * 4, pitch, cx * 4, rows);
+	}
+}
+
+static void CopyHashRows_C(ST_HashState &state, uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	const uint8_t *scramble = s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN;
+	size_t stripes = rowBytes / HASH_STRIPE_LEN;
+	size_t tail = rowBytes % HASH_STRIPE_LEN;
+
+	for (uint32_t y = 0; y < rows; y++) {
+		const uint8_t *s = src + size_t(srcPitch) * y;
+		uint8_t *d = dst + size_t(dstPitch) * y;
+
+		for (size_t i = 0; i < stripes; i++) {
+			const uint8_t *secret = s_secret.bytes + state.stripes * 8;
+			for (int k = 0; k < 8; k++) {
+				uint64_t data = Read64(s + 8 * k);
+				memcpy(d + 8 * k, &data, 8);
+
+				uint64_t key = data ^ Read64(secret + 8 * k);
+				state.acc[k ^ 1] += data;
+				state.acc[k] += (key & 0xFFFFFFFF) * (key >> 32);
+			}
+
+			if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+				state.stripes = 0;
+				ScrambleScalar(state.acc, scramble);
+			}
+
+			s += HASH_STRIPE_LEN;
+			d += HASH_STRIPE_LEN;
+		}
+
+		if (tail) {
+			memcpy(d, s, tail);
+			HashTailScalar(state, d, tail);
+		}
+
+		state.length += rowBytes;
+	}
+}
+
+#ifdef MAG_HASH_SSE2
+static void CopyHashRows_SSE2(ST_HashState &state, uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	const uint8_t *scramble = s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN;
+	size_t stripes = rowBytes / HASH_STRIPE_LEN;
+	size_t tail = rowBytes % HASH_STRIPE_LEN;
+	const __m128i prime = _mm_set1_epi32((int)PRIME32_1);
+
+	__m128i acc[4];
+	for (int k = 0; k < 4; k++)
+		acc[k] = _mm_loadu_si128((const __m128i *)state.acc + k);
+
+	for (uint32_t y = 0; y < rows; y++) {
+		const uint8_t *s = src + size_t(srcPitch) * y;
+		uint8_t *d = dst + size_t(dstPitch) * y;
+
+		for (size_t i = 0; i < stripes; i++) {
+			const uint8_t *secret = s_secret.bytes + state.stripes * 8;
+			for (int k = 0; k < 4; k++) {
+				__m128i data = _mm_loadu_si128((const __m128i *)s + k);
+				_mm_storeu_si128((__m128i *)d + k, data);
+
+				__m128i key = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)secret + k));
+				__m128i product = _mm_mul_epu32(key, _mm_shuffle_epi32(key, _MM_SHUFFLE(0, 3, 0, 1)));
+				__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+				acc[k] = _mm_add_epi64(product, _mm_add_epi64(acc[k], swapped));
+			}
+
+			if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+				state.stripes = 0;
+				for (int k = 0; k < 4; k++) {
+					__m128i v = _mm_xor_si128(acc[k], _mm_srli_epi64(acc[k], 47));
+					v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)scramble + k));
+					__m128i productLo = _mm_mul_epu32(v, prime);
+					__m128i productHi = _mm_mul_epu32(_mm_shuffle_epi32(v, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+					acc[k] = _mm_add_epi64(productLo, _mm_slli_epi64(productHi, 32));
+				}
+			}
+
+			s += HASH_STRIPE_LEN;
+			d += HASH_STRIPE_LEN;
+		}
+
+		if (tail) {
+			for (int k = 0; k < 4; k++)
+				_mm_storeu_si128((__m128i *)state.acc + k, acc[k]);
+
+			memcpy(d, s, tail);
+			HashTail(state, d, tail);
+
+			for (int k = 0; k < 4; k++)
+				acc[k] = _mm_loadu_si128((const __m128i *)state.acc + k);
+		}
+
+		state.length += rowBytes;
+	}
+
+	for (int k = 0; k < 4; k++)
+		_mm_storeu_si128((__m128i *)state.acc + k, acc[k]);
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+MAG_TARGET_AVX2 static void CopyHashRows_AVX2(ST_HashState &state, uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	const uint8_t *scramble = s_secret.bytes + HASH_SECRET_LEN - HASH_STRIPE_LEN;
+	size_t stripes = rowBytes / HASH_STRIPE_LEN;
+	size_t tail = rowBytes % HASH_STRIPE_LEN;
+
+	__m256i acc0 = _mm256_loadu_si256((const __m256i *)state.acc);
+	__m256i acc1 = _mm256_loadu_si256((const __m256i *)state.acc + 1);
+
+	for (uint32_t y = 0; y < rows; y++) {
+		const uint8_t *s = src + size_t(srcPitch) * y;
+		uint8_t *d = dst + size_t(dstPitch) * y;
+
+		for (size_t i = 0; i < stripes; i++) {
+			const uint8_t *secret = s_secret.bytes + state.stripes * 8;
+			__m256i data0 = _mm256_loadu_si256((const __m256i *)s);
+			__m256i data1 = _mm256_loadu_si256((const __m256i *)s + 1);
+			_mm256_storeu_si256((__m256i *)d, data0);
+			_mm256_storeu_si256((__m256i *)d + 1, data1);
+
+			acc0 = AccumulateAVX2(acc0, data0, secret);
+			acc1 = AccumulateAVX2(acc1, data1, secret + 32);
+
+			if (++state.stripes == HASH_STRIPES_PER_BLOCK) {
+				state.stripes = 0;
+				acc0 = ScrambleAVX2(acc0, scramble);
+				acc1 = ScrambleAVX2(acc1, scramble + 32);
+			}
+
+			s += HASH_STRIPE_LEN;
+			d += HASH_STRIPE_LEN;
+		}
+
+		if (tail) {
+			_mm256_storeu_si256((__m256i *)state.acc, acc0);
+			_mm256_storeu_si256((__m256i *)state.acc + 1, acc1);
+
+			memcpy(d, s, tail);
+			HashTail(state, d, tail);
+
+			acc0 = _mm256_loadu_si256((const __m256i *)state.acc);
+			acc1 = _mm256_loadu_si256((const __m256i *)state.acc + 1);
+		}
+
+		state.length += rowBytes;
+	}
+
+	_mm256_storeu_si256((__m256i *)state.acc, acc0);
+	_mm256_storeu_si256((__m256i *)state.acc + 1, acc1);
+}
+#endif
+
+typedef void (*CopyHashRows_t)(ST_HashState &, uint8_t *, int32_t, const uint8_t *, int32_t, uint32_t, uint32_t);
+
+static Kernel<CopyHashRows_t> s_CopyHashRows("CopyHashRows", {
+	{MAG_CPU_SCALAR, CopyHashRows_C},
+#ifdef MAG_HASH_SSE2
+	{MAG_CPU_SSE2, CopyHashRows_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, CopyHashRows_AVX2},
+#endif
+});
+
+void CopyHashRows(ST_HashState &state, uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	s_CopyHashRows.Get()(state, dst, dstPitch, src, srcPitch, rowBytes, rows);
+}
+
+uint64_t CopyHashPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows)
+{
+	ST_HashState state;
+	HashInit(state);
+	CopyHashRows(state, dst, dstPitch, src, srcPitch, rowBytes, rows);
+	return HashFinal(state);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+帧/图块哈希 (XXH3 风格的 64 位累加哈希)
+每 64 字节 (stripe) 用 32x32->64 乘法累加到 8 个通道，每 16 个 stripe 做一次扰动，
+标量、SSE2、AVX2 版本的结果逐位一致。每一行的尾部不足 64 字节时补零，
+因此同样形状的图块总是得到可以互相比较的哈希。
+CopyHashRows 在拷贝的同一次遍历中完成哈希，不需要第二次读取整帧。
+*/
+
+struct ST_HashState {
+	uint64_t acc[8];
+	uint32_t stripes; // position inside the current block, selects the key
+	uint64_t length;
+};
+
+void HashInit(ST_HashState &state);
+void HashRow(ST_HashState &state, const uint8_t *data, size_t bytes);
+uint64_t HashFinal(const ST_HashState &state);
+
+uint64_t HashPlane(const uint8_t *data, int32_t pitch, uint32_t rowBytes, uint32_t rows);
+
+// Copies the rows and feeds them to state in the same pass, same result as HashRow over the copied rows
+void CopyHashRows(ST_HashState &state, uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows);
+uint64_t CopyHashPlane(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows);
+
+// Hashes one band of rows (at most tileSize) of a 32bpp plane, one hash per tile column
+void HashTileBand32(const uint8_t *data, int32_t pitch, uint32_t width, uint32_t rows, uint32_t tileSize, uint64_t *hashes);
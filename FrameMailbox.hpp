@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <utility>
+#include <stdint.h>
+
+/*
+单生产者/单消费者的 "最新帧" 邮箱 (triple buffer)
+生产者(magnifier线程)与消费者(PopVideo)各持有一个槽位，中间槽位通过原子交换传递，
+双方都不会阻塞，也不需要锁。新的帧会覆盖尚未被取走的旧帧 (latest frame wins)。
+*/
+
+template<class T> class FrameMailbox {
+public:
+	FrameMailbox() = default;
+	FrameMailbox(const FrameMailbox &) = delete;
+	FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+	// Producer side. Publishing an empty T clears the mailbox.
+	void Publish(T value)
+	{
+		m_slots[m_back] = std::move(value);
+
+		uint32_t prev = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel);
+		m_back = prev & INDEX_MASK;
+
+		// either a frame nobody took or the consumer's drained slot, drop it here
+		m_slots[m_back] = T();
+	}
+
+	// Consumer side. Returns false if nothing new was published since the last call.
+	bool Take(T &out)
+	{
+		if (!(m_middle.load(std::memory_order_acquire) & FRESH_BIT))
+			return false;
+
+		uint32_t prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+		m_front = prev & INDEX_MASK;
+
+		out = std::move(m_slots[m_front]);
+		m_slots[m_front] = T();
+		return true;
+	}
+
+	bool HasFresh() const { return (m_middle.load(std::memory_order_acquire) & FRESH_BIT) != 0; }
+
+private:
+	static const uint32_t FRESH_BIT = 0x4;
+	static const uint32_t INDEX_MASK = 0x3;
+
+	T m_slots[3];
+	uint32_t m_back = 0;                  // owned by producer
+	uint32_t m_front = 1;                 // owned by consumer
+	std::atomic<uint32_t> m_middle = {2}; // index of shared slot | FRESH_BIT
+};
@@ -0,0 +1,290 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include "FrameAlignment.hpp"
+
+/*
+帧对象池
+帧对象带有侵入式引用计数 (AddRef/Release，可直接配合 ComPtr 使用)。
+最后一个引用在任意线程释放时，帧会被无锁地压入池的归还栈，不需要投递任务或窗口消息；
+池的拥有者线程在下一次 Acquire 时一次性取走归还栈，再按 size class 复用缓冲区。
+缓冲区大小按 size class 向上取整 (每个2的幂区间分为8档，浪费不超过12.5%)，
+因此捕获区域的小幅变化仍然可以复用已有的缓冲区。
+*/
+
+struct ST_FramePoolStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint32_t highWater = 0; // max frames handed out at the same time
+	uint32_t idle = 0;
+};
+
+class FramePoolBase;
+
+class PooledFrame {
+	friend class FramePoolBase;
+
+public:
+	PooledFrame() = default;
+	PooledFrame(const PooledFrame &) = delete;
+	PooledFrame &operator=(const PooledFrame &) = delete;
+
+	virtual ~PooledFrame() { AlignedFree(data); }
+
+	void AddRef() { m_nRefs.fetch_add(1, std::memory_order_relaxed); }
+	long Release();
+
+	// True if the caller holds the only reference, nobody else can observe a write
+	bool IsExclusive() const { return m_nRefs.load(std::memory_order_acquire) == 1; }
+
+	// Called when the last reference is released, before the frame goes back to the pool
+	virtual void Reset() {}
+
+	uint8_t *data = nullptr;
+	size_t capacity = 0;  // bytes allocated behind data
+	size_t alignment = 0; // alignment of data
+
+private:
+	std::atomic<long> m_nRefs = {0};
+	FramePoolBase *m_pPool = nullptr;
+	PooledFrame *m_pNext = nullptr;
+};
+
+class FramePoolBase {
+	friend class PooledFrame;
+
+public:
+	static const size_t DEFAULT_DEPTH = 3;
+	static const size_t MIN_CLASS_BYTES = 4096;
+
+	FramePoolBase(const FramePoolBase &) = delete;
+	FramePoolBase &operator=(const FramePoolBase &) = delete;
+
+	static size_t ClassBytes(size_t size)
+	{
+		if (size <= MIN_CLASS_BYTES)
+			return MIN_CLASS_BYTES;
+
+		int bits = 0;
+		while ((size >> bits) > 15)
+			++bits;
+
+		size_t step = size_t(1) << bits;
+		return (size + step - 1) & ~(step - 1);
+	}
+
+	void AddRef() { m_nRefs.fetch_add(1, std::memory_order_relaxed); }
+	long Release()
+	{
+		long refs = m_nRefs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+		if (refs == 0)
+			delete this;
+		return refs;
+	}
+
+	// Accessed in owner thread
+	void SetDepth(size_t depth)
+	{
+		m_nDepth = depth;
+		DrainReturned();
+		while (m_vIdle.size() > m_nDepth) {
+			delete m_vIdle.back();
+			m_vIdle.pop_back();
+		}
+
+		m_vIdle.reserve(m_nDepth);
+		m_nIdle = (uint32_t)m_vIdle.size();
+	}
+
+	size_t GetDepth() const { return m_nDepth; }
+
+	// Base alignment of new buffers, MAG_CACHE_LINE or MAG_PAGE_SIZE
+	void SetAlignment(size_t alignment) { m_nAlignment = alignment; }
+	size_t GetAlignment() const { return m_nAlignment; }
+
+	void Clear()
+	{
+		DrainReturned();
+		for (auto &item : m_vIdle)
+			delete item;
+
+		m_vIdle.clear();
+		m_nIdle = 0;
+	}
+
+	ST_FramePoolStats GetStats() const
+	{
+		ST_FramePoolStats ret;
+		ret.hits = m_nHits;
+		ret.misses = m_nMisses;
+		ret.highWater = m_nHighWater;
+		ret.idle = m_nIdle;
+		return ret;
+	}
+
+protected:
+	explicit FramePoolBase(size_t depth) { SetDepth(depth); }
+
+	virtual ~FramePoolBase()
+	{
+		assert(m_nOutstanding == 0);
+		Clear();
+	}
+
+	virtual PooledFrame *CreateFrame() = 0;
+
+	// Accessed in owner thread. The returned frame holds one reference.
+	PooledFrame *AcquireFrame(size_t size)
+	{
+		m_nLastSize = size;
+		DrainReturned();
+
+		size_t best = m_vIdle.size();
+		for (size_t i = 0; i < m_vIdle.size(); i++) {
+			if (!Fits(m_vIdle[i], size))
+				continue;
+
+			if (best == m_vIdle.size() || m_vIdle[i]->capacity < m_vIdle[best]->capacity)
+				best = i;
+		}
+
+		PooledFrame *frame = nullptr;
+		if (best < m_vIdle.size()) {
+			frame = m_vIdle[best];
+			m_vIdle[best] = m_vIdle.back();
+			m_vIdle.pop_back();
+			++m_nHits;
+		} else {
+			// nothing idle fits the new geometry: reuse the frame object of the largest one, so a shrunken region
+			// does not keep the old buffers pinned while every Acquire allocates
+			size_t largest = m_vIdle.size();
+			for (size_t i = 0; i < m_vIdle.size(); i++) {
+				if (largest == m_vIdle.size() || m_vIdle[i]->capacity > m_vIdle[largest]->capacity)
+					largest = i;
+			}
+
+			if (largest < m_vIdle.size()) {
+				frame = m_vIdle[largest];
+				m_vIdle[largest] = m_vIdle.back();
+				m_vIdle.pop_back();
+			} else {
+				frame = CreateFrame();
+			}
+
+			size_t wanted = ClassBytes(size);
+			AlignedFree(frame->data);
+			frame->data = AlignedMalloc(wanted, m_nAlignment);
+			frame->capacity = wanted;
+			frame->alignment = m_nAlignment;
+			++m_nMisses;
+		}
+
+		m_nIdle = (uint32_t)m_vIdle.size();
+		uint32_t outstanding = m_nOutstanding.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (outstanding > m_nHighWater)
+			m_nHighWater = outstanding;
+
+		frame->m_pPool = this;
+		frame->m_nRefs.store(1, std::memory_order_relaxed);
+		AddRef();
+		return frame;
+	}
+
+private:
+	// Any thread, lock free
+	void Return(PooledFrame *frame)
+	{
+		frame->Reset();
+		m_nOutstanding.fetch_sub(1, std::memory_order_relaxed);
+
+		PooledFrame *head = m_pReturned.load(std::memory_order_relaxed);
+		do {
+			frame->m_pNext = head;
+		} while (!m_pReturned.compare_exchange_weak(head, frame, std::memory_order_release, std::memory_order_relaxed));
+
+		Release();
+	}
+
+	// Owner thread only: the whole stack is taken at once so there is no ABA
+	void DrainReturned()
+	{
+		PooledFrame *list = m_pReturned.exchange(nullptr, std::memory_order_acquire);
+		while (list) {
+			PooledFrame *next = list->m_pNext;
+			list->m_pNext = nullptr;
+
+			if (m_vIdle.size() < m_nDepth) {
+				m_vIdle.push_back(list);
+			} else if (m_nLastSize && Fits(list, m_nLastSize)) {
+				// keep the frame of the current geometry, an idle one of an older size class goes instead
+				size_t stale = m_vIdle.size();
+				for (size_t i = 0; i < m_vIdle.size() && stale == m_vIdle.size(); i++) {
+					if (!Fits(m_vIdle[i], m_nLastSize))
+						stale = i;
+				}
+
+				if (stale < m_vIdle.size()) {
+					delete m_vIdle[stale];
+					m_vIdle[stale] = list;
+				} else {
+					delete list;
+				}
+			} else {
+				delete list;
+			}
+
+			list = next;
+		}
+
+		m_nIdle = (uint32_t)m_vIdle.size();
+	}
+
+	// Owner thread only: size fits the buffer, which is at most one size class larger
+	bool Fits(const PooledFrame *frame, size_t size) const
+	{
+		size_t limit = ClassBytes(ClassBytes(size) + 1); // accept one class larger
+		return frame->capacity >= size && frame->capacity <= limit && frame->alignment >= m_nAlignment;
+	}
+
+	std::atomic<long> m_nRefs = {1};
+	std::atomic<PooledFrame *> m_pReturned = {nullptr};
+
+	// Accessed in owner thread
+	size_t m_nDepth = 0;
+	size_t m_nAlignment = MAG_CACHE_LINE;
+	size_t m_nLastSize = 0; // of the latest Acquire, decides which frames DrainReturned keeps
+	std::vector<PooledFrame *> m_vIdle;
+
+	// Read from any thread
+	std::atomic<uint32_t> m_nOutstanding = {0};
+	std::atomic<uint64_t> m_nHits = {0};
+	std::atomic<uint64_t> m_nMisses = {0};
+	std::atomic<uint32_t> m_nHighWater = {0};
+	std::atomic<uint32_t> m_nIdle = {0};
+};
+
+inline long PooledFrame::Release()
+{
+	long refs = m_nRefs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+	if (refs == 0) {
+		if (m_pPool)
+			m_pPool->Return(this);
+		else
+			delete this;
+	}
+	return refs;
+}
+
+template<class T> class FramePool : public FramePoolBase {
+public:
+	explicit FramePool(size_t depth = DEFAULT_DEPTH) : FramePoolBase(depth) {}
+
+	// The returned frame holds one reference, attach it with ComPtr::Set
+	T *Acquire(size_t size) { return static_cast<T *>(AcquireFrame(size)); }
+
+protected:
+	PooledFrame *CreateFrame() override { return new T(); }
+};
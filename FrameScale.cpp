@@ -0,0 +1,511 @@
+#include "FrameScale.h"
+#include "CpuFeatures.h"
+#include "KernelDispatch.h"
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAG_SCALE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MAG_ARCH_X86
+#include <immintrin.h>
+#endif
+
+#define SCALE_SHIFT 14
+#define SCALE_ROW_SHIFT 8 // vertical pass keeps 14 - 8 = 6 fractional bits
+#define SCALE_COL_SHIFT (2 * SCALE_SHIFT - SCALE_ROW_SHIFT)
+
+// Elements [begin, end) of one vertical pass output row
+typedef void (*ScaleRows_t)(const uint8_t *const *rows, const int16_t *weights, uint32_t taps, size_t begin, size_t end, int16_t *out);
+// Output pixels [begin, end) of one row
+typedef void (*ScaleCols_t)(const int16_t *row, const ST_ScaleAxis &axis, uint32_t begin, uint32_t end, uint8_t *out);
+
+void BuildScaleAxis(ST_ScaleAxis &axis, MagScaleFilter filter, uint32_t srcSize, uint32_t dstSize)
+{
+	assert(srcSize && dstSize);
+
+	double scale = double(srcSize) / dstSize;
+	std::vector<int32_t> firsts(dstSize);
+	std::vector<std::vector<double>> spans(dstSize);
+	uint32_t taps = 1;
+
+	for (uint32_t x = 0; x < dstSize; x++) {
+		double begin = x * scale;
+		double end = (x + 1) * scale;
+		std::vector<double> &span = spans[x];
+		int32_t first = 0;
+
+		if (filter == MAG_SCALE_BILINEAR) {
+			double center = (x + 0.5) * scale - 0.5;
+			double index = floor(center);
+			double frac = center - index;
+			first = (int32_t)index;
+			span.push_back(1.0 - frac);
+			span.push_back(frac);
+		} else if (filter == MAG_SCALE_AREA) {
+			first = (int32_t)floor(begin);
+			int32_t last = (int32_t)ceil(end) - 1;
+			for (int32_t i = first; i <= last; i++)
+				span.push_back(fmin(end, i + 1.0) - fmax(begin, (double)i));
+		} else {
+			first = (int32_t)ceil(begin - 0.5);
+			int32_t last = (int32_t)ceil(end - 0.5) - 1;
+			if (last < first)
+				first = last = (int32_t)floor((x + 0.5) * scale); // upscaling, nearest pixel
+
+			span.assign(size_t(last - first + 1), 1.0);
+		}
+
+		// fold taps outside the source onto the edge pixels
+		while (first < 0 && span.size() > 1) {
+			span[1] += span[0];
+			span.erase(span.begin());
+			++first;
+		}
+		while (first + (int32_t)span.size() > (int32_t)srcSize && span.size() > 1) {
+			span[span.size() - 2] += span.back();
+			span.pop_back();
+		}
+		if (first < 0)
+			first = 0;
+		if (first >= (int32_t)srcSize)
+			first = (int32_t)srcSize - 1;
+
+		firsts[x] = first;
+		if (span.size() > taps)
+			taps = (uint32_t)span.size();
+	}
+
+	if (taps > srcSize)
+		taps = srcSize;
+
+	axis.taps = taps;
+	axis.starts.resize(dstSize);
+	axis.weights.assign(size_t(dstSize) * taps, 0);
+
+	for (uint32_t x = 0; x < dstSize; x++) {
+		const std::vector<double> &span = spans[x];
+		int32_t start = firsts[x];
+		if (start + (int32_t)taps > (int32_t)srcSize)
+			start = (int32_t)srcSize - (int32_t)taps;
+
+		double total = 0;
+		for (double w : span)
+			total += w;
+
+		// round every weight, the largest one takes the remainder so the sum is exact
+		int16_t *weights = axis.weights.data() + size_t(x) * taps;
+		int32_t sum = 0;
+		uint32_t largest = 0;
+		for (size_t i = 0; i < span.size(); i++) {
+			uint32_t pos = uint32_t(firsts[x] - start) + (uint32_t)i;
+			int16_t w = (int16_t)floor(span[i] / total * (1 << SCALE_SHIFT) + 0.5);
+			weights[pos] = w;
+			sum += w;
+			if (w > weights[largest])
+				largest = pos;
+		}
+
+		weights[largest] = (int16_t)(weights[largest] + (1 << SCALE_SHIFT) - sum);
+		axis.starts[x] = start;
+	}
+
+	uint32_t pairCount = (taps + 1) / 2;
+	axis.pairs.resize(size_t(dstSize) * pairCount);
+	for (uint32_t x = 0; x < dstSize; x++) {
+		const int16_t *weights = axis.weights.data() + size_t(x) * taps;
+		for (uint32_t k = 0; k < pairCount; k++) {
+			uint16_t lo = (uint16_t)weights[2 * k];
+			uint16_t hi = (2 * k + 1 < taps) ? (uint16_t)weights[2 * k + 1] : 0;
+			axis.pairs[size_t(x) * pairCount + k] = (int32_t)(((uint32_t)hi << 16) | lo);
+		}
+	}
+}
+
+static void ScaleRows_C(const uint8_t *const *rows, const int16_t *weights, uint32_t taps, size_t begin, size_t end, int16_t *out)
+{
+	for (size_t i = begin; i < end; i++) {
+		int32_t acc = 0;
+		for (uint32_t k = 0; k < taps; k++)
+			acc += rows[k][i] * weights[k];
+
+		out[i] = (int16_t)((acc + (1 << (SCALE_ROW_SHIFT - 1))) >> SCALE_ROW_SHIFT);
+	}
+}
+
+static inline uint8_t ClampPixel(int32_t value)
+{
+	return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static void ScaleCols_C(const int16_t *row, const ST_ScaleAxis &axis, uint32_t begin, uint32_t end, uint8_t *out)
+{
+	for (uint32_t x = begin; x < end; x++) {
+		const int16_t *src = row + size_t(axis.starts[x]) * 4;
+		const int16_t *weights = axis.weights.data() + size_t(x) * axis.taps;
+
+		for (int c = 0; c < 4; c++) {
+			int32_t acc = 0;
+			for (uint32_t t = 0; t < axis.taps; t++)
+				acc += src[t * 4 + c] * weights[t];
+
+			out[x * 4 + c] = ClampPixel((acc + (1 << (SCALE_COL_SHIFT - 1))) >> SCALE_COL_SHIFT);
+		}
+	}
+}
+
+#ifdef MAG_SCALE_SSE2
+// Taps are taken in pairs: pmaddwd of interleaved (row k, row k + 1) with (w[k], w[k + 1])
+static void ScaleRows_SSE2(const uint8_t *const *rows, const int16_t *weights, uint32_t taps, size_t begin, size_t end, int16_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (SCALE_ROW_SHIFT - 1));
+	size_t i = begin;
+
+	for (; i + 16 <= end; i += 16) {
+		__m128i acc[4] = {round, round, round, round};
+
+		for (uint32_t k = 0; k < taps; k += 2) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(rows[k] + i));
+			__m128i b = zero;
+			int32_t pair = (uint16_t)weights[k];
+			if (k + 1 < taps) {
+				b = _mm_loadu_si128((const __m128i *)(rows[k + 1] + i));
+				pair |= (int32_t)((uint32_t)(uint16_t)weights[k + 1] << 16);
+			}
+
+			__m128i w = _mm_set1_epi32(pair);
+			__m128i aLo = _mm_unpacklo_epi8(a, zero);
+			__m128i aHi = _mm_unpackhi_epi8(a, zero);
+			__m128i bLo = _mm_unpacklo_epi8(b, zero);
+			__m128i bHi = _mm_unpackhi_epi8(b, zero);
+			acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(aLo, bLo), w));
+			acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(aLo, bLo), w));
+			acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(aHi, bHi), w));
+			acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(aHi, bHi), w));
+		}
+
+		for (int j = 0; j < 4; j++)
+			acc[j] = _mm_srai_epi32(acc[j], SCALE_ROW_SHIFT);
+
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(acc[0], acc[1]));
+		_mm_storeu_si128((__m128i *)(out + i + 8), _mm_packs_epi32(acc[2], acc[3]));
+	}
+
+	ScaleRows_C(rows, weights, taps, i, end, out);
+}
+
+// One output pixel per step, two source pixels (8 x int16) per load.
+// With an odd tap count the last load reads the padding pixel of row, its weight is zero.
+static void ScaleCols_SSE2(const int16_t *row, const ST_ScaleAxis &axis, uint32_t begin, uint32_t end, uint8_t *out)
+{
+	const __m128i round = _mm_set1_epi32(1 << (SCALE_COL_SHIFT - 1));
+	uint32_t pairCount = (axis.taps + 1) / 2;
+
+	for (uint32_t x = begin; x < end; x++) {
+		const int16_t *src = row + size_t(axis.starts[x]) * 4;
+		const int32_t *pairs = axis.pairs.data() + size_t(x) * pairCount;
+		__m128i acc = round;
+
+		for (uint32_t k = 0; k < pairCount; k++) {
+			__m128i px = _mm_loadu_si128((const __m128i *)(src + k * 8));
+			__m128i interleaved = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8)); // (p0.c, p1.c) per channel
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(interleaved, _mm_set1_epi32(pairs[k])));
+		}
+
+		acc = _mm_srai_epi32(acc, SCALE_COL_SHIFT);
+		acc = _mm_packs_epi32(acc, acc);
+		int32_t px = _mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+		memcpy(out + size_t(x) * 4, &px, 4); // out has no alignment
+	}
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+MAG_TARGET_AVX2 static void ScaleRows_AVX2(const uint8_t *const *rows, const int16_t *weights, uint32_t taps, size_t begin, size_t end, int16_t *out)
+{
+	const __m256i round = _mm256_set1_epi32(1 << (SCALE_ROW_SHIFT - 1));
+	size_t i = begin;
+
+	for (; i + 16 <= end; i += 16) {
+		__m256i acc0 = round;
+		__m256i acc1 = round;
+
+		for (uint32_t k = 0; k < taps; k += 2) {
+			__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k] + i)));
+			__m256i b = _mm256_setzero_si256();
+			int32_t pair = (uint16_t)weights[k];
+			if (k + 1 < taps) {
+				b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(rows[k + 1] + i)));
+				pair |= (int32_t)((uint32_t)(uint16_t)weights[k + 1] << 16);
+			}
+
+			// per 128 bit lane: lo holds elements 0-3 / 8-11, hi holds 4-7 / 12-15
+			__m256i w = _mm256_set1_epi32(pair);
+			acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+			acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+		}
+
+		acc0 = _mm256_srai_epi32(acc0, SCALE_ROW_SHIFT);
+		acc1 = _mm256_srai_epi32(acc1, SCALE_ROW_SHIFT);
+		// packs works per lane as well, which restores the order of the unpack
+		_mm256_storeu_si256((__m256i *)(out + i), _mm256_packs_epi32(acc0, acc1));
+	}
+
+	ScaleRows_C(rows, weights, taps, i, end, out);
+}
+
+// Same as ScaleRows_AVX2 with four lanes, 32 elements per step
+MAG_TARGET_AVX512 static void ScaleRows_AVX512(const uint8_t *const *rows, const int16_t *weights, uint32_t taps, size_t begin, size_t end, int16_t *out)
+{
+	const __m512i round = _mm512_set1_epi32(1 << (SCALE_ROW_SHIFT - 1));
+	size_t i = begin;
+
+	for (; i + 32 <= end; i += 32) {
+		__m512i acc0 = round;
+		__m512i acc1 = round;
+
+		for (uint32_t k = 0; k < taps; k += 2) {
+			__m512i a = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(rows[k] + i)));
+			__m512i b = _mm512_setzero_si512();
+			int32_t pair = (uint16_t)weights[k];
+			if (k + 1 < taps) {
+				b = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(rows[k + 1] + i)));
+				pair |= (int32_t)((uint32_t)(uint16_t)weights[k + 1] << 16);
+			}
+
+			__m512i w = _mm512_set1_epi32(pair);
+			acc0 = _mm512_add_epi32(acc0, _mm512_madd_epi16(_mm512_unpacklo_epi16(a, b), w));
+			acc1 = _mm512_add_epi32(acc1, _mm512_madd_epi16(_mm512_unpackhi_epi16(a, b), w));
+		}
+
+		acc0 = _mm512_srai_epi32(acc0, SCALE_ROW_SHIFT);
+		acc1 = _mm512_srai_epi32(acc1, SCALE_ROW_SHIFT);
+		_mm512_storeu_si512((void *)(out + i), _mm512_packs_epi32(acc0, acc1));
+	}
+
+	ScaleRows_AVX2(rows, weights, taps, i, end, out);
+}
+
+// Two output pixels per step, one in each 128 bit lane
+MAG_TARGET_AVX2 static void ScaleCols_AVX2(const int16_t *row, const ST_ScaleAxis &axis, uint32_t begin, uint32_t end, uint8_t *out)
+{
+	const __m256i round = _mm256_set1_epi32(1 << (SCALE_COL_SHIFT - 1));
+	uint32_t pairCount = (axis.taps + 1) / 2;
+	uint32_t x = begin;
+
+	for (; x + 2 <= end; x += 2) {
+		const int16_t *src0 = row + size_t(axis.starts[x]) * 4;
+		const int16_t *src1 = row + size_t(axis.starts[x + 1]) * 4;
+		const int32_t *pairs0 = axis.pairs.data() + size_t(x) * pairCount;
+		const int32_t *pairs1 = pairs0 + pairCount;
+		__m256i acc = round;
+
+		for (uint32_t k = 0; k < pairCount; k++) {
+			__m256i px = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src0 + k * 8)));
+			px = _mm256_inserti128_si256(px, _mm_loadu_si128((const __m128i *)(src1 + k * 8)), 1);
+			__m256i w = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32(pairs0[k])), _mm_set1_epi32(pairs1[k]), 1);
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_unpacklo_epi16(px, _mm256_srli_si256(px, 8)), w));
+		}
+
+		acc = _mm256_srai_epi32(acc, SCALE_COL_SHIFT);
+		__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+		_mm_storel_epi64((__m128i *)(out + size_t(x) * 4), _mm_packus_epi16(packed, packed));
+	}
+
+	ScaleCols_C(row, axis, x, end, out);
+}
+#endif
+
+static Kernel<ScaleRows_t> s_ScaleRows("ScaleRows", {
+	{MAG_CPU_SCALAR, ScaleRows_C},
+#ifdef MAG_SCALE_SSE2
+	{MAG_CPU_SSE2, ScaleRows_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, ScaleRows_AVX2},
+	{MAG_CPU_AVX512, ScaleRows_AVX512},
+#endif
+});
+
+static Kernel<ScaleCols_t> s_ScaleCols("ScaleCols", {
+	{MAG_CPU_SCALAR, ScaleCols_C},
+#ifdef MAG_SCALE_SSE2
+	{MAG_CPU_SSE2, ScaleCols_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, ScaleCols_AVX2},
+#endif
+});
+
+bool FrameScaler::Prepare(MagScaleFilter filter, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight)
+{
+	if (filter == m_Filter && srcWidth == m_uSrcWidth && srcHeight == m_uSrcHeight && dstWidth == m_uDstWidth && dstHeight == m_uDstHeight)
+		return false;
+
+	m_Filter = filter;
+	m_uSrcWidth = srcWidth;
+	m_uSrcHeight = srcHeight;
+	m_uDstWidth = dstWidth;
+	m_uDstHeight = dstHeight;
+
+	BuildScaleAxis(m_AxisX, filter, srcWidth, dstWidth);
+	BuildScaleAxis(m_AxisY, filter, srcHeight, dstHeight);
+	return true;
+}
+
+void FrameScaler::Scale32(const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch) const
+{
+	Scale32Rows(src, srcPitch, dst, dstPitch, 0, m_uDstHeight);
+}
+
+void FrameScaler::Scale32Rows(const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch, uint32_t rowBegin, uint32_t rowEnd) const
+{
+	ScaleRows_t scaleRows = s_ScaleRows.Get();
+	ScaleCols_t scaleCols = s_ScaleCols.Get();
+
+	assert(m_uDstWidth && m_uDstHeight && rowEnd <= m_uDstHeight);
+
+	// vertical pass output, one source row plus one zero pixel of padding. Per thread, bands may run in parallel
+	static thread_local std::vector<int16_t> s_vRow;
+	static thread_local std::vector<const uint8_t *> s_vTapRows;
+	s_vRow.resize(size_t(m_uSrcWidth + 1) * 4);
+	s_vTapRows.resize(m_AxisY.taps);
+	memset(s_vRow.data() + size_t(m_uSrcWidth) * 4, 0, 4 * sizeof(int16_t));
+
+	for (uint32_t y = rowBegin; y < rowEnd; y++) {
+		const int16_t *weights = m_AxisY.weights.data() + size_t(y) * m_AxisY.taps;
+		for (uint32_t k = 0; k < m_AxisY.taps; k++)
+			s_vTapRows[k] = src + size_t(srcPitch) * (m_AxisY.starts[y] + k);
+
+		scaleRows(s_vTapRows.data(), weights, m_AxisY.taps, 0, size_t(m_uSrcWidth) * 4, s_vRow.data());
+		scaleCols(s_vRow.data(), m_AxisX, 0, m_uDstWidth, dst + size_t(dstPitch) * y);
+	}
+}
+
+typedef void (*Downsample2xRow_t)(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *out);
+
+// width output pixels, reads 2 * width input pixels of both rows
+static void Downsample2xRow_C(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *out)
+{
+	for (uint32_t i = 0; i < width * 4; i++) {
+		uint32_t x = (i / 4) * 8 + (i % 4);
+		out[i] = (uint8_t)((s0[x] + s0[x + 4] + s1[x] + s1[x + 4] + 2) >> 2);
+	}
+}
+
+#ifdef MAG_SCALE_SSE2
+static void Downsample2xRow_SSE2(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i sums[4];
+		for (int i = 0; i < 2; i++) {
+			__m128i a = _mm_loadu_si128((const __m128i *)(s0 + size_t(x) * 8) + i);
+			__m128i b = _mm_loadu_si128((const __m128i *)(s1 + size_t(x) * 8) + i);
+			sums[2 * i] = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+			sums[2 * i + 1] = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		}
+
+		// every sum holds two pixels, add the upper one onto the lower one
+		for (int i = 0; i < 4; i++)
+			sums[i] = _mm_add_epi16(sums[i], _mm_srli_si128(sums[i], 8));
+
+		__m128i lo = _mm_unpacklo_epi64(sums[0], sums[1]);
+		__m128i hi = _mm_unpacklo_epi64(sums[2], sums[3]);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+		_mm_storeu_si128((__m128i *)(out + size_t(x) * 4), _mm_packus_epi16(lo, hi));
+	}
+
+	Downsample2xRow_C(s0 + size_t(x) * 8, s1 + size_t(x) * 8, width - x, out + size_t(x) * 4);
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+// pshufb puts the same channel of a pixel pair next to each other, pmaddubsw with ones adds them
+MAG_TARGET_SSSE3 static void Downsample2xRow_SSSE3(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *out)
+{
+	const __m128i order = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+	const __m128i ones = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi16(2);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i sums[2];
+		for (int i = 0; i < 2; i++) {
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s0 + size_t(x) * 8) + i), order);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(s1 + size_t(x) * 8) + i), order);
+			sums[i] = _mm_add_epi16(_mm_maddubs_epi16(a, ones), _mm_maddubs_epi16(b, ones));
+			sums[i] = _mm_srli_epi16(_mm_add_epi16(sums[i], two), 2);
+		}
+
+		_mm_storeu_si128((__m128i *)(out + size_t(x) * 4), _mm_packus_epi16(sums[0], sums[1]));
+	}
+
+	Downsample2xRow_C(s0 + size_t(x) * 8, s1 + size_t(x) * 8, width - x, out + size_t(x) * 4);
+}
+
+MAG_TARGET_AVX2 static void Downsample2xRow_AVX2(const uint8_t *s0, const uint8_t *s1, uint32_t width, uint8_t *out)
+{
+	const __m256i order = _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+	const __m256i ones = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi16(2);
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m256i sums[2];
+		for (int i = 0; i < 2; i++) {
+			__m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(s0 + size_t(x) * 8) + i), order);
+			__m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(s1 + size_t(x) * 8) + i), order);
+			sums[i] = _mm256_add_epi16(_mm256_maddubs_epi16(a, ones), _mm256_maddubs_epi16(b, ones));
+			sums[i] = _mm256_srli_epi16(_mm256_add_epi16(sums[i], two), 2);
+		}
+
+		// packus works per lane: 0-1, 4-5 | 2-3, 6-7
+		__m256i packed = _mm256_packus_epi16(sums[0], sums[1]);
+		_mm256_storeu_si256((__m256i *)(out + size_t(x) * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+
+	Downsample2xRow_SSSE3(s0 + size_t(x) * 8, s1 + size_t(x) * 8, width - x, out + size_t(x) * 4);
+}
+#endif
+
+static Kernel<Downsample2xRow_t> s_Downsample2xRow("Downsample2xRow", {
+	{MAG_CPU_SCALAR, Downsample2xRow_C},
+#ifdef MAG_SCALE_SSE2
+	{MAG_CPU_SSE2, Downsample2xRow_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_SSSE3, Downsample2xRow_SSSE3},
+	{MAG_CPU_AVX2, Downsample2xRow_AVX2},
+#endif
+});
+
+void Downsample2x32(const uint8_t *src, int32_t srcPitch, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, int32_t dstPitch)
+{
+	Downsample2xRow_t impl = s_Downsample2xRow.Get();
+
+	uint32_t width = srcWidth / 2;
+	uint32_t height = srcHeight > 1 ? srcHeight / 2 : 1;
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *s0 = src + size_t(srcPitch) * (2 * y);
+		const uint8_t *s1 = (srcHeight > 1) ? s0 + srcPitch : s0;
+		uint8_t *d = dst + size_t(dstPitch) * y;
+
+		if (width) {
+			impl(s0, s1, width, d);
+		} else {
+			// a single column averages with itself
+			for (int c = 0; c < 4; c++)
+				d[c] = (uint8_t)((2 * s0[c] + 2 * s1[c] + 2) >> 2);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+32bpp 缩放 (可分离滤波：先纵向再横向)
+系数表在尺寸或滤波器改变时由 Prepare 生成一次，每帧只做乘加。
+系数为 14 位定点数，纵向结果保留 6 位小数 (int16)，标量与 SIMD 版本的结果逐位一致。
+Downsample2x32 是金字塔用的 2x2 平均，不需要系数表。
+*/
+
+enum MagScaleFilter {
+	MAG_SCALE_BOX = 0,  // equal weights over the source pixels whose centers fall into the footprint
+	MAG_SCALE_BILINEAR, // two taps at the output pixel center, fast but aliases below 0.5x
+	MAG_SCALE_AREA,     // weighted by the exact overlap of source and output pixel
+};
+
+// Coefficients of one direction, every output index uses the same number of taps
+struct ST_ScaleAxis {
+	uint32_t taps = 0;
+	std::vector<int32_t> starts;  // first source index per output index
+	std::vector<int16_t> weights; // taps per output index, sum is 1 << 14
+	std::vector<int32_t> pairs;   // the same weights as (w[k], w[k + 1]) for pmaddwd, zero padded to an even count
+};
+
+class FrameScaler {
+public:
+	// Returns false if nothing changed and the tables are reused
+	bool Prepare(MagScaleFilter filter, uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight);
+
+	void Scale32(const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch) const;
+	// Only the output rows [rowBegin, rowEnd), different bands can be scaled on different threads at the same time
+	void Scale32Rows(const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch, uint32_t rowBegin, uint32_t rowEnd) const;
+
+	uint32_t GetDstWidth() const { return m_uDstWidth; }
+	uint32_t GetDstHeight() const { return m_uDstHeight; }
+
+private:
+	MagScaleFilter m_Filter = MAG_SCALE_AREA;
+	uint32_t m_uSrcWidth = 0;
+	uint32_t m_uSrcHeight = 0;
+	uint32_t m_uDstWidth = 0;
+	uint32_t m_uDstHeight = 0;
+
+	ST_ScaleAxis m_AxisX;
+	ST_ScaleAxis m_AxisY;
+};
+
+void BuildScaleAxis(ST_ScaleAxis &axis, MagScaleFilter filter, uint32_t srcSize, uint32_t dstSize);
+
+// 2x2 box filter of a 32bpp plane into max(1, width / 2) x max(1, height / 2), rounded to nearest
+void Downsample2x32(const uint8_t *src, int32_t srcPitch, uint32_t srcWidth, uint32_t srcHeight, uint8_t *dst, int32_t dstPitch);
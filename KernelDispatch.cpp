@@ -0,0 +1,105 @@
+#include "KernelDispatch.h"
+#include "CpuFeatures.h"
+#include <mutex>
+#include <assert.h>
+
+// Both are constant initialized, so kernels of any translation unit can register during static initialization
+static KernelSlot *s_pSlots = nullptr;
+static std::atomic<MagCpuLevel> s_Limit{MAG_CPU_AUTO};
+static std::mutex s_lockSelect;
+
+static const char *const s_szLevelNames[] = {"scalar", "sse2", "ssse3", "avx2", "avx512", "auto"};
+
+KernelSlot::KernelSlot(const char *name) : m_szName(name), m_pNext(s_pSlots)
+{
+	s_pSlots = this;
+}
+
+void KernelSlot::SetVariant(MagCpuLevel level, KernelFunc_t func)
+{
+	assert(level < MAG_CPU_AUTO);
+	m_Variants[level] = func;
+}
+
+uint32_t KernelSlot::GetVariants() const
+{
+	uint32_t mask = 0;
+	for (int i = 0; i < MAG_CPU_AUTO; i++) {
+		if (m_Variants[i])
+			mask |= 1u << i;
+	}
+
+	return mask;
+}
+
+void KernelSlot::Select(MagCpuLevel level)
+{
+	MagCpuLevel supported = GetSupportedCpuLevel();
+	if (level > supported)
+		level = supported;
+
+	int i = (int)level;
+	while (i > MAG_CPU_SCALAR && !m_Variants[i])
+		i--;
+
+	assert(m_Variants[i]); // the scalar variant is missing
+	m_Level.store((MagCpuLevel)i, std::memory_order_relaxed);
+	m_pActive.store(m_Variants[i], std::memory_order_relaxed);
+}
+
+static MagCpuLevel DetectCpuLevel()
+{
+	// each level implies the ones below it
+	const ST_CpuFeatures &features = GetCpuFeatures();
+	if (!features.sse2)
+		return MAG_CPU_SCALAR;
+	if (!features.ssse3)
+		return MAG_CPU_SSE2;
+	if (!features.avx2)
+		return MAG_CPU_SSSE3;
+	if (!features.avx512bw)
+		return MAG_CPU_AVX2;
+	return MAG_CPU_AVX512;
+}
+
+MagCpuLevel GetSupportedCpuLevel()
+{
+	static const MagCpuLevel level = DetectCpuLevel();
+	return level;
+}
+
+MagCpuLevel GetKernelLevelLimit()
+{
+	return s_Limit.load(std::memory_order_relaxed);
+}
+
+MagCpuLevel SelectKernels(MagCpuLevel level)
+{
+	std::lock_guard<std::mutex> autoLock(s_lockSelect);
+
+	s_Limit.store(level, std::memory_order_relaxed);
+	for (KernelSlot *slot = s_pSlots; slot; slot = slot->m_pNext)
+		slot->Select(level);
+
+	MagCpuLevel supported = GetSupportedCpuLevel();
+	return (level < supported) ? level : supported;
+}
+
+std::vector<ST_KernelInfo> GetKernelInfo()
+{
+	std::vector<ST_KernelInfo> ret;
+	for (const KernelSlot *slot = s_pSlots; slot; slot = slot->m_pNext) {
+		ST_KernelInfo info;
+		info.name = slot->GetName();
+		info.active = slot->GetLevel();
+		info.variants = slot->GetVariants();
+		ret.push_back(info);
+	}
+
+	return ret;
+}
+
+const char *GetCpuLevelName(MagCpuLevel level)
+{
+	return (level >= MAG_CPU_SCALAR && level <= MAG_CPU_AUTO) ? s_szLevelNames[level] : "unknown";
+}
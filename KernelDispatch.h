@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <initializer_list>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+像素内核的运行时分发
+每个内核把各指令集版本登记为一个 Kernel 对象 (静态初始化时加入全局链表)，
+MagnifierCore::Init 按 cpuid 结果统一选择一次，之后每次调用只是一次原子指针读取。
+SelectKernels 可以限制最高指令集 (测试用)，GetKernelInfo 返回每个内核当前使用的版本。
+*/
+
+enum MagCpuLevel {
+	MAG_CPU_SCALAR = 0,
+	MAG_CPU_SSE2,
+	MAG_CPU_SSSE3,
+	MAG_CPU_AVX2,
+	MAG_CPU_AVX512, // AVX-512 BW
+	MAG_CPU_AUTO,   // the highest level the CPU supports
+};
+
+struct ST_KernelInfo {
+	const char *name = nullptr;
+	MagCpuLevel active = MAG_CPU_SCALAR; // variant in use
+	uint32_t variants = 0;               // bit per MagCpuLevel with a registered variant
+};
+
+typedef void (*KernelFunc_t)();
+
+// Highest level the CPU and the OS support
+MagCpuLevel GetSupportedCpuLevel();
+
+// Level passed to the last SelectKernels, MAG_CPU_AUTO before the first call
+MagCpuLevel GetKernelLevelLimit();
+
+class KernelSlot {
+public:
+	const char *GetName() const { return m_szName; }
+	MagCpuLevel GetLevel() const { return m_Level.load(std::memory_order_relaxed); }
+	uint32_t GetVariants() const;
+
+protected:
+	explicit KernelSlot(const char *name);
+	KernelSlot(const KernelSlot &) = delete;
+	KernelSlot &operator=(const KernelSlot &) = delete;
+
+	void SetVariant(MagCpuLevel level, KernelFunc_t func);
+	void Select(MagCpuLevel level);
+	KernelFunc_t GetActive() const { return m_pActive.load(std::memory_order_relaxed); }
+
+private:
+	friend MagCpuLevel SelectKernels(MagCpuLevel level);
+	friend std::vector<ST_KernelInfo> GetKernelInfo();
+
+	const char *m_szName;
+	KernelSlot *m_pNext;
+	KernelFunc_t m_Variants[MAG_CPU_AUTO] = {};
+	std::atomic<KernelFunc_t> m_pActive{nullptr};
+	std::atomic<MagCpuLevel> m_Level{MAG_CPU_SCALAR};
+};
+
+// Defined at namespace scope next to the variants, a MAG_CPU_SCALAR entry is required
+template <typename F> class Kernel : public KernelSlot {
+public:
+	struct ST_Variant {
+		MagCpuLevel level;
+		F func;
+	};
+
+	Kernel(const char *name, std::initializer_list<ST_Variant> variants) : KernelSlot(name)
+	{
+		for (const ST_Variant &variant : variants)
+			SetVariant(variant.level, reinterpret_cast<KernelFunc_t>(variant.func));
+
+		Select(GetKernelLevelLimit());
+	}
+
+	F Get() const { return reinterpret_cast<F>(GetActive()); }
+};
+
+// Every kernel switches to its best variant at or below level (clamped to what the CPU supports),
+// returns the effective limit. Kernels may be switched while frames are processed.
+MagCpuLevel SelectKernels(MagCpuLevel level = MAG_CPU_AUTO);
+
+std::vector<ST_KernelInfo> GetKernelInfo();
+const char *GetCpuLevelName(MagCpuLevel level);
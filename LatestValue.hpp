@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <stdint.h>
+
+/*
+最新值优先 (latest wins) 的控制参数
+任意线程调用 Set 覆盖尚未生效的旧值并递增版本号，不投递任务；
+magnifier 线程每个 tick 调用一次 Take，版本号没有变化时只是一次原子读取，
+两次 Take 之间的多次 Set 只有最后一次生效，被覆盖的次数由 Set 的返回值报告。
+*/
+
+template <class T> class LatestValue {
+public:
+	LatestValue() = default;
+	LatestValue(const LatestValue &) = delete;
+	LatestValue &operator=(const LatestValue &) = delete;
+
+	// Any thread. Returns false if the previous value was not taken yet and got replaced
+	bool Set(T value)
+	{
+		std::lock_guard<std::mutex> autoLock(m_lock);
+		uint32_t version = m_nVersion.load(std::memory_order_relaxed);
+		m_value = std::move(value);
+		m_nVersion.store(version + 1, std::memory_order_release);
+		return version == m_uTaken;
+	}
+
+	// Consumer thread only. Returns true with the newest value if Set was called since the last Take
+	bool Take(T &out)
+	{
+		if (m_nVersion.load(std::memory_order_acquire) == m_uTaken)
+			return false;
+
+		std::lock_guard<std::mutex> autoLock(m_lock);
+		out = std::move(m_value);
+		m_uTaken = m_nVersion.load(std::memory_order_relaxed);
+		return true;
+	}
+
+	uint32_t GetVersion() const { return m_nVersion.load(std::memory_order_acquire); }
+
+private:
+	std::mutex m_lock;
+	T m_value = T();
+	std::atomic<uint32_t> m_nVersion = {0};
+	uint32_t m_uTaken = 0; // version of the last Take, written by the consumer under m_lock
+};
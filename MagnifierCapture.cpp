@@ -6,16 +6,36 @@
 
 #define MAG_WINDOW_CLASS TEXT("MagnifierWindow")
 #define MSG_MAG_TASK WM_USER + 1
-#define MAG_TICK_TIMER_ID 1000
-#define MAX_IDLE_FRAME_COUNT 1
 #define MAG_CAPTURE_ABORT 200 // in ms
+#define MAG_BAND_MIN_BYTES (4 << 20) // a smaller stage is done before the band workers wake up
+
+thread_local MagnifierCapture *MagnifierCapture::s_pCurrent = nullptr;
+
+// QueryPerformanceCounter in ns, the time base of m_Scheduler
+static uint64_t GetClockTime()
+{
+	static const uint64_t freq = []() {
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		return (uint64_t)f.QuadPart;
+	}();
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	uint64_t count = (uint64_t)now.QuadPart;
+	return (count / freq) * 1000000000ull + (count % freq) * 1000000000ull / freq;
+}
 
 unsigned __stdcall MagnifierCapture::MagnifierThread(void *pParam)
 {
 	MagnifierCapture *self = reinterpret_cast<MagnifierCapture *>(pParam);
+	s_pCurrent = self;
+
 	self->MagnifierThreadInner();
 	self->RunTask();
 	self->FreeDX();
+
+	s_pCurrent = nullptr;
 	return 0;
 }
 
@@ -28,13 +48,6 @@ LRESULT __stdcall MagnifierCapture::HostWndProc(HWND hWnd, UINT message, WPARAM
 		PostQuitMessage(0);
 		return 0;
 
-	case WM_TIMER:
-		if (self && wParam == MAG_TICK_TIMER_ID) {
-			self->CaptureVideo();
-			return 0;
-		}
-		break;
-
 	case MSG_MAG_TASK:
 		if (self) {
 			self->RunTask();
@@ -49,9 +62,15 @@ LRESULT __stdcall MagnifierCapture::HostWndProc(HWND hWnd, UINT message, WPARAM
 	return DefWindowProc(hWnd, message, wParam, lParam);
 }
 
-MagnifierCapture::MagnifierCapture()
+MagnifierCapture::MagnifierCapture(BandPool *pool) : m_BandQueue(pool)
 {
 	RegisterMagClass();
+	m_pFramePool.Set(new FramePool<ST_MagnifierFrame>());
+	m_pYuvPool.Set(new FramePool<ST_MagnifierFrame>());
+	m_pPyramidPool.Set(new FramePool<PooledFrame>());
+	m_pStagingPool.Set(new FramePool<PooledFrame>());
+	CalcYuvCoefs(MAG_MATRIX_BT709, MAG_RANGE_LIMITED, m_YuvCoefs);
+	CalcYuvCoefs(MAG_MATRIX_BT709, MAG_RANGE_LIMITED, m_OutputCoefs);
 }
 
 MagnifierCapture::~MagnifierCapture()
@@ -63,57 +82,249 @@ MagnifierCapture::~MagnifierCapture()
 void MagnifierCapture::SetFPS(int fps)
 {
 	assert(fps >= 10);
+	SetFrameRate((UINT)fps, 1);
+}
+
+void MagnifierCapture::SetFrameRate(UINT num, UINT den)
+{
+	assert(num && den);
+	if (!CaptureScheduler::ClampRate(num, den))
+		return;
+
+	ST_FrameRate rate;
+	rate.num = num;
+	rate.den = den;
+	SetControl(m_Controls.frameRate, rate);
+}
+
+void MagnifierCapture::SetExcludeWindow(std::vector<HWND> filter)
+{
+	SetControl(m_Controls.excludeWindows, std::move(filter));
+}
 
+void MagnifierCapture::SetCaptureRegion(RECT rcScreen)
+{
+	SetControl(m_Controls.captureRegion, rcScreen);
+}
+
+void MagnifierCapture::SetCropRegion(RECT rcCrop)
+{
 	std::shared_ptr<MagnifierCapture> self = shared_from_this();
 	assert(self);
 	if (!self)
 		return;
 
-	PushTask([self, fps]() {
-		if (IsWindow(self->m_hHostWindow)) {
-			KillTimer(self->m_hHostWindow, MAG_TICK_TIMER_ID);
-			SetTimer(self->m_hHostWindow, MAG_TICK_TIMER_ID, 1000 / fps, NULL);
-		}
+	PushTask([self, rcCrop]() { self->m_rcCrop = rcCrop; });
+}
+
+void MagnifierCapture::SetTileDamage(bool enable, UINT tileSize)
+{
+	assert(tileSize >= 16);
+
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, enable, tileSize]() {
+		self->m_bTileDamage = enable;
+		self->m_uTileSize = tileSize;
+		self->m_vTileHashes.clear();
 	});
 }
 
-void MagnifierCapture::SetExcludeWindow(std::vector<HWND> filter)
+void MagnifierCapture::SetFrameHash(bool enable)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, enable]() { self->m_bFrameHash = enable; });
+}
+
+void MagnifierCapture::SetFramePoolDepth(size_t depth)
 {
 	std::shared_ptr<MagnifierCapture> self = shared_from_this();
 	assert(self);
 	if (!self)
 		return;
 
-	PushTask([self, filter]() {
-		if (!filter.empty())
-			MagSetWindowFilterList(self->m_hMagChild, MW_FILTERMODE_EXCLUDE, (int)filter.size(), (HWND *)filter.data());
+	PushTask([self, depth]() {
+		self->m_pFramePool->SetDepth(depth);
+		self->m_pYuvPool->SetDepth(depth);
+		self->m_pPyramidPool->SetDepth(depth);
 	});
 }
 
-void MagnifierCapture::SetCaptureRegion(RECT rcScreen)
+void MagnifierCapture::SetReadbackLatency(UINT frames)
 {
+	assert(frames <= MAG_MAX_READBACK_LATENCY);
+
 	std::shared_ptr<MagnifierCapture> self = shared_from_this();
 	assert(self);
 	if (!self)
 		return;
 
-	PushTask([self, rcScreen]() { self->m_rcCaptureScreen = rcScreen; });
+	PushTask([self, frames]() {
+		self->m_uReadbackLatency = frames;
+		if (!self->m_StagingRing.IsInited())
+			return;
+
+		// copies in flight are dropped with their dirty rects, the next frame is a full one
+		self->m_StagingRing.Uninit();
+		self->m_pLastFrame = nullptr;
+		if (!self->m_StagingRing.Init(&self->m_StagingDevice, frames))
+			self->FreeDX();
+	});
 }
 
-std::pair<std::shared_ptr<ST_MagnifierFrame>, bool> MagnifierCapture::PopVideo()
+void MagnifierCapture::SetFrameAlignment(bool bPageAligned, MagPitchPolicy policy)
 {
-	std::lock_guard<std::recursive_mutex> autoLock(m_lockFrame);
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, bPageAligned, policy]() {
+		self->m_pFramePool->SetAlignment(bPageAligned ? MAG_PAGE_SIZE : MAG_CACHE_LINE);
+		self->m_pYuvPool->SetAlignment(bPageAligned ? MAG_PAGE_SIZE : MAG_CACHE_LINE);
+		self->m_PitchPolicy = policy;
+	});
+}
 
-	if (m_vFrameList.empty()) {
+void MagnifierCapture::SetCopyMode(MagCopyMode mode)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, mode]() { self->m_CopyMode = mode; });
+}
+
+void MagnifierCapture::SetBandThreads(UINT threads)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, threads]() { self->m_BandQueue.SetMaxThreads(threads); });
+}
+
+void MagnifierCapture::SetDuplicateSuppression(bool enable)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, enable]() { self->m_bSkipDuplicate = enable; });
+}
+
+void MagnifierCapture::SetDemandCapture(bool enable, UINT maxStaleness)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, enable, maxStaleness]() {
+		self->m_bDemandCapture = enable;
+		self->m_uMaxStaleness = maxStaleness;
+	});
+}
+
+void MagnifierCapture::SetColorConversion(MagYuvFormat format, MagColorMatrix matrix, MagColorRange range)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, format, matrix, range]() {
+		self->m_YuvFormat = format;
+		CalcYuvCoefs(matrix, range, self->m_YuvCoefs);
+		if (format == MAG_YUV_NONE)
+			self->m_pYuvPool->Clear();
+	});
+}
+
+void MagnifierCapture::SetOutputSize(UINT width, UINT height, MagScaleFilter filter)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, width, height, filter]() {
+		self->m_pLastFrame = nullptr; // dirty rects of the next capture do not describe the rescaled frame
+		self->m_uOutputWidth = width;
+		self->m_uOutputHeight = height;
+		self->m_ScaleFilter = filter;
+	});
+}
+
+void MagnifierCapture::SetPyramidLevels(UINT count)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, count]() {
+		self->m_uPyramidLevels = (count < MAG_MAX_PYRAMID_LEVELS) ? count : MAG_MAX_PYRAMID_LEVELS;
+		if (!count)
+			self->m_pPyramidPool->Clear();
+	});
+}
+
+void MagnifierCapture::SetOutputFormat(MagOutputFormat format, MagColorMatrix matrix, MagColorRange range)
+{
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self, format, matrix, range]() {
+		if (self->m_OutputFormat != format)
+			self->m_pLastFrame = nullptr; // hash and dirty rects of the other format are not comparable
+
+		self->m_OutputFormat = format;
+		CalcYuvCoefs(matrix, range, self->m_OutputCoefs);
+	});
+}
+
+ST_CaptureStats MagnifierCapture::GetCaptureStats() const
+{
+	ST_CaptureStats ret;
+	ret.publishedFrames = m_nPublishedFrames;
+	ret.duplicateFrames = m_nDuplicateFrames;
+	ret.readbacks = m_nReadbacks;
+	ret.avoidedReadbacks = m_nAvoidedReadbacks;
+	ret.coalescedUpdates = m_nCoalescedUpdates;
+	ret.bands = m_BandQueue.GetStats();
+	ret.schedule = m_Scheduler.GetStats();
+	ret.staging = m_StagingRing.GetStats();
+	return ret;
+}
+
+ST_FramePoolStats MagnifierCapture::GetFramePoolStats() const
+{
+	return m_pFramePool->GetStats();
+}
+
+std::pair<ComPtr<ST_MagnifierFrame>, bool> MagnifierCapture::PopVideo()
+{
+	ComPtr<ST_MagnifierFrame> ret;
+	if (!m_FrameMailbox.Take(ret) || !ret) {
 		ULONGLONG pre = m_dwPreCaptureTime;
 		ULONGLONG crt = GetTickCount64();
 		bool timeout = (crt > pre && (crt - pre) >= MAG_CAPTURE_ABORT);
 		return std::make_pair(nullptr, !timeout);
 	}
 
-	auto ret = m_vFrameList.at(0);
-	m_vFrameList.erase(m_vFrameList.begin());
-
 	return std::make_pair(ret, true);
 }
 
@@ -145,6 +356,8 @@ void MagnifierCapture::Stop()
 		return;
 
 	PushTask([self, this]() {
+		m_bTicking = false;
+		m_Scheduler.Stop();
 		if (IsWindow(m_hHostWindow))
 			DestroyWindow(m_hHostWindow);
 
@@ -193,16 +406,56 @@ void MagnifierCapture::MagnifierThreadInner()
 	UpdateWindow(m_hHostWindow);
 
 	RunTask();
-
-	MSG msg;
-	while (GetMessage(&msg, NULL, 0, 0)) {
-		TranslateMessage(&msg);
-		DispatchMessage(&msg);
-	}
+	RunMessageLoop();
 
 	MagUninitialize();
 }
 
+// Messages and capture ticks. The thread sleeps on a waitable timer armed for the next deadline of m_Scheduler
+// instead of WM_TIMER, which is rounded to the system tick and low priority behind other messages
+void MagnifierCapture::RunMessageLoop()
+{
+	// high resolution timers are not rounded to the system tick, they need Windows 10 1803
+	HANDLE hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!hTimer)
+		hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+
+	for (;;) {
+		if (m_Scheduler.OnTick(GetClockTime()))
+			CaptureVideo();
+
+		DWORD dwCount = 0;
+		DWORD dwTimeout = INFINITE;
+		if (m_Scheduler.IsRunning()) {
+			uint64_t wait = m_Scheduler.GetWait(GetClockTime());
+
+			LARGE_INTEGER due;
+			due.QuadPart = -(LONGLONG)(wait / 100); // relative, in 100 ns
+			if (!due.QuadPart)
+				due.QuadPart = -1;
+
+			if (hTimer && SetWaitableTimer(hTimer, &due, 0, NULL, NULL, FALSE))
+				dwCount = 1;
+			else
+				dwTimeout = (DWORD)((wait + 999999) / 1000000);
+		}
+
+		MsgWaitForMultipleObjectsEx(dwCount, &hTimer, dwTimeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+		MSG msg;
+		while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+			if (msg.message == WM_QUIT) {
+				if (hTimer)
+					CloseHandle(hTimer);
+				return;
+			}
+
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+}
+
 bool MagnifierCapture::SetupMagnifier(HINSTANCE hInst)
 {
 	DWORD dwStyle = WS_POPUP | WS_CLIPCHILDREN;
@@ -248,6 +501,8 @@ bool MagnifierCapture::SetupMagnifier(HINSTANCE hInst)
 
 void MagnifierCapture::CaptureVideo()
 {
+	ApplyControls();
+
 	LONG cx = m_rcCaptureScreen.right - m_rcCaptureScreen.left;
 	LONG cy = m_rcCaptureScreen.bottom - m_rcCaptureScreen.top;
 	if (!cx || !cy)
@@ -262,36 +517,82 @@ void MagnifierCapture::CaptureVideo()
 	MagSetWindowSource(m_hMagChild, m_rcCaptureScreen);
 }
 
-void MagnifierCapture::PushTask(std::function<void()> func)
+void MagnifierCapture::PushTask(InlineTask task)
 {
 	if (GetCurrentThreadId() == m_dwThreadID) {
-		func();
+		task();
 		return;
 	}
 
-	{
-		std::lock_guard<std::recursive_mutex> autoLock(m_lockTask);
-		m_vTaskList.push_back(func);
+	// only full if the magnifier thread is stuck or gone
+	while (!m_TaskQueue.Push(task)) {
+		if (!IsWindow(m_hHostWindow)) {
+			assert(false);
+			return;
+		}
+		SwitchToThread();
 	}
 
-	if (IsWindow(m_hHostWindow))
-		PostMessage(m_hHostWindow, MSG_MAG_TASK, 0, 0);
+	// a burst of pushes posts one message, RunTask clears the flag before draining
+	if (!m_bTaskPosted.exchange(true, std::memory_order_acq_rel)) {
+		if (!IsWindow(m_hHostWindow) || !PostMessage(m_hHostWindow, MSG_MAG_TASK, 0, 0))
+			m_bTaskPosted.store(false, std::memory_order_release); // drained when the thread starts, or never
+	}
 }
 
 void MagnifierCapture::RunTask()
 {
-	std::vector<std::function<void()>> tasks;
+	assert(GetCurrentThreadId() == m_dwThreadID);
+
+	// pushes from here on post again, the exchange also makes every push that saw the flag set visible to Pop
+	m_bTaskPosted.exchange(false, std::memory_order_acq_rel);
+
+	InlineTask task;
+	while (m_TaskQueue.Pop(task)) {
+		task();
+		task.Clear(); // drop the captured references right away
+	}
+}
+
+// Only the newest value is kept until the next tick, no task is queued per call
+template <typename T> void MagnifierCapture::SetControl(LatestValue<T> &control, T value)
+{
+	if (!control.Set(std::move(value)))
+		++m_nCoalescedUpdates;
 
-	{
-		std::lock_guard<std::recursive_mutex> autoLock(m_lockTask);
-		tasks.swap(m_vTaskList);
+	if (m_bTicking)
+		return;
+
+	// not scheduled yet (the first SetFPS starts it), apply right away
+	std::shared_ptr<MagnifierCapture> self = shared_from_this();
+	assert(self);
+	if (!self)
+		return;
+
+	PushTask([self]() { self->ApplyControls(); });
+}
+
+void MagnifierCapture::ApplyControls()
+{
+	assert(GetCurrentThreadId() == m_dwThreadID);
+
+	// a new rate restarts the deadlines from now
+	ST_FrameRate rate;
+	if (m_Controls.frameRate.Take(rate) && IsWindow(m_hHostWindow)) {
+		m_Scheduler.Start(rate.num, rate.den, GetClockTime());
+		m_bTicking = true;
 	}
 
-	for (auto &item : tasks)
-		item();
+	RECT rcScreen;
+	if (m_Controls.captureRegion.Take(rcScreen))
+		m_rcCaptureScreen = rcScreen;
+
+	std::vector<HWND> filter;
+	if (m_Controls.excludeWindows.Take(filter) && !filter.empty())
+		MagSetWindowFilterList(m_hMagChild, MW_FILTERMODE_EXCLUDE, (int)filter.size(), filter.data());
 }
 
-bool MagnifierCapture::OnPresentEx(IDirect3DDevice9Ex *device)
+bool MagnifierCapture::OnPresentEx(IDirect3DDevice9Ex *device, const RGNDATA *dirtyRegion)
 {
 	assert(GetCurrentThreadId() == m_dwThreadID);
 
@@ -303,7 +604,12 @@ bool MagnifierCapture::OnPresentEx(IDirect3DDevice9Ex *device)
 	if (!m_pDeviceEx)
 		return false; // never inited
 
-	return CaptureDX9();
+	if (!CaptureDX9(dirtyRegion)) {
+		m_pLastFrame = nullptr; // missed a present, dirty rects of the next one are not enough
+		return false;
+	}
+
+	return true;
 }
 
 void MagnifierCapture::FreeDX()
@@ -311,8 +617,10 @@ void MagnifierCapture::FreeDX()
 	assert(GetCurrentThreadId() == m_dwThreadID);
 
 	m_pDeviceEx = nullptr;
-	m_pSurface = nullptr;
+	m_StagingRing.Uninit();
+	m_StagingDevice.Close();
 	m_D3DFormat = D3DFMT_UNKNOWN;
+	m_SrcFormat = MAG_PIXEL_UNKNOWN;
 	m_uWidth = 0;
 	m_uHeight = 0;
 	m_nPitch = 0;
@@ -343,6 +651,26 @@ void MagnifierCapture::CheckFree(IDirect3DDevice9Ex *device)
 	}
 }
 
+static MagPixelFormat GetPixelFormat(D3DFORMAT format)
+{
+	switch (format) {
+	case D3DFMT_A8R8G8B8: // DXGI_FORMAT_B8G8R8A8_UNORM
+		return MAG_PIXEL_BGRA8;
+
+	case D3DFMT_X8R8G8B8: // DXGI_FORMAT_B8G8R8X8_UNORM
+		return MAG_PIXEL_BGRX8;
+
+	case D3DFMT_A2R10G10B10: // DXGI_FORMAT_R10G10B10A2_UNORM
+		return MAG_PIXEL_RGB10A2;
+
+	case D3DFMT_A16B16G16R16F: // DXGI_FORMAT_R16G16B16A16_FLOAT
+		return MAG_PIXEL_RGBA16F;
+
+	default:
+		return MAG_PIXEL_UNKNOWN;
+	}
+}
+
 bool MagnifierCapture::InitTextureInfo(IDirect3DDevice9Ex *device)
 {
 	ComPtr<IDirect3DSwapChain9> swap;
@@ -371,23 +699,16 @@ bool MagnifierCapture::InitTextureInfo(IDirect3DDevice9Ex *device)
 		}
 	}
 
-	return (m_D3DFormat == D3DFMT_A8R8G8B8); // DXGI_FORMAT_B8G8R8A8_UNORM
+	m_SrcFormat = GetPixelFormat(m_D3DFormat);
+	return (m_SrcFormat != MAG_PIXEL_UNKNOWN);
 }
 
 bool MagnifierCapture::CreateCopySurface(IDirect3DDevice9Ex *device)
 {
-	HRESULT hr = device->CreateOffscreenPlainSurface(m_uWidth, m_uHeight, m_D3DFormat, D3DPOOL_SYSTEMMEM, &m_pSurface, nullptr);
-	if (FAILED(hr))
+	if (!m_StagingDevice.Open(device, m_D3DFormat, m_uWidth, m_uHeight) || !m_StagingRing.Init(&m_StagingDevice, m_uReadbackLatency))
 		return false;
 
-	D3DLOCKED_RECT rect;
-	hr = m_pSurface->LockRect(&rect, nullptr, D3DLOCK_READONLY);
-	if (FAILED(hr))
-		return false;
-
-	m_nPitch = rect.Pitch;
-	m_pSurface->UnlockRect();
-
+	m_nPitch = m_StagingDevice.GetPitch();
 	return true;
 }
 
@@ -407,93 +728,547 @@ bool MagnifierCapture::InitDX9(IDirect3DDevice9Ex *device)
 	return true;
 }
 
-bool MagnifierCapture::CaptureDX9()
+bool MagnifierCapture::CaptureDX9(const RGNDATA *dirtyRegion)
 {
 	assert(m_pDeviceEx);
 
-	ComPtr<IDirect3DSurface9> bkBuffer;
-	HRESULT hr = m_pDeviceEx->GetRenderTarget(0, bkBuffer.Assign());
-	if (FAILED(hr))
-		return false;
+	RECT rcCrop;
+	GetCropRect(rcCrop);
+
+	ST_DirtyRectList dirty;
+	bool bPartial = GetDirtyRects(dirtyRegion, rcCrop, dirty);
+	int32_t cropWidth = rcCrop.right - rcCrop.left;
+	int32_t cropHeight = rcCrop.bottom - rcCrop.top;
+
+	ULONGLONG now = GetTickCount64();
+	if (!NeedReadback(now)) {
+		// the next readback has to refresh what this present changed
+		if (!bPartial)
+			m_bSkippedFull = true;
+		else if (!m_bSkippedFull)
+			MergeDirtyRects(m_SkippedDirty, dirty, cropWidth, cropHeight);
+
+		m_bSkippedPresent = true;
+		++m_nAvoidedReadbacks;
+		m_dwPreCaptureTime = now; // still capturing, for PopVideo
+		return true;
+	}
 
-	hr = m_pDeviceEx->GetRenderTargetData(bkBuffer, m_pSurface);
-	if (FAILED(hr))
+	// copies still in the ring were made before the skipped presents, reading them would hand out a frame that old
+	bool bFlush = m_bSkippedPresent && m_StagingRing.GetPending();
+	if (m_bSkippedPresent) {
+		if (m_bSkippedFull || bFlush)
+			bPartial = false;
+		else if (bPartial)
+			MergeDirtyRects(dirty, m_SkippedDirty, cropWidth, cropHeight);
+
+		m_bSkippedPresent = false;
+		m_bSkippedFull = false;
+		ClearDirtyRects(m_SkippedDirty);
+	}
+
+	m_dwLastReadback = now;
+	++m_nReadbacks;
+
+	// this present goes into the ring, the one read below was copied m_uReadbackLatency presents ago
+	uint32_t slot;
+	if (!m_StagingRing.Push(slot))
 		return false;
 
+	ST_StagingMeta &pushed = m_StagingMeta[slot];
+	pushed.rcCrop = rcCrop;
+	pushed.bPartial = bPartial;
+	pushed.dirty = dirty;
+
+	ST_StagingLock lock;
+	if (bFlush) {
+		// this present, in full: the dropped copies' changes are not in its dirty rects
+		if (!m_StagingRing.PopLatest(slot, lock))
+			return false;
+	} else {
+		if (!m_StagingRing.HasDue())
+			return true; // still filling up after a reset
+
+		if (!m_StagingRing.Pop(slot, lock))
+			return false;
+	}
+
+	const ST_StagingMeta &meta = m_StagingMeta[slot];
+	assert(lock.pitch == m_nPitch);
+	UINT width = UINT(meta.rcCrop.right - meta.rcCrop.left);
+	UINT height = UINT(meta.rcCrop.bottom - meta.rcCrop.top);
+
 	D3DLOCKED_RECT rect;
-	hr = m_pSurface->LockRect(&rect, nullptr, D3DLOCK_READONLY);
-	if (FAILED(hr))
+	rect.Pitch = lock.pitch;
+	rect.pBits = (void *)(lock.bits + size_t(lock.pitch) * meta.rcCrop.top + size_t(GetPixelBytes(m_SrcFormat)) * meta.rcCrop.left);
+	const ST_DirtyRectList *pDirty = meta.bPartial ? &meta.dirty : nullptr;
+
+	if (m_SrcFormat == MAG_PIXEL_BGRA8) {
+		PushVideo(rect, width, height, pDirty);
+		m_StagingRing.Unlock(slot);
+		return true;
+	}
+
+	// one extra pass into BGRA, the rest of the pipeline only knows 32 bit BGRA
+	INT pitch = (INT)AlignUp(size_t(width) * 4, MAG_CACHE_LINE);
+	ComPtr<PooledFrame> staging;
+	staging.Set(m_pStagingPool->Acquire(size_t(pitch) * height));
+	const uint8_t *src = (const uint8_t *)rect.pBits;
+	RunBands(height, 1, size_t(pitch) * height, [&](UINT begin, UINT end) {
+		ConvertToBGRA(m_SrcFormat, src + size_t(rect.Pitch) * begin, rect.Pitch, staging->data + size_t(pitch) * begin, pitch, width, end - begin);
+	});
+	m_StagingRing.Unlock(slot);
+
+	D3DLOCKED_RECT converted;
+	converted.Pitch = pitch;
+	converted.pBits = staging->data;
+	PushVideo(converted, width, height, pDirty);
+
+	return true;
+}
+
+// Demand capture: nothing to do while the consumer has not taken the last frame, unless that frame got too old
+bool MagnifierCapture::NeedReadback(ULONGLONG now) const
+{
+	if (!m_bDemandCapture || !m_pLastFrame || !m_FrameMailbox.HasFresh())
+		return true;
+
+	return (now - m_dwLastReadback) >= m_uMaxStaleness;
+}
+
+// Returns false if the whole surface is captured, rcCrop is always filled
+bool MagnifierCapture::GetCropRect(RECT &rcCrop)
+{
+	RECT rcSurface = {0, 0, (LONG)m_uWidth, (LONG)m_uHeight};
+	if (IsRectEmpty(&m_rcCrop) || !IntersectRect(&rcCrop, &m_rcCrop, &rcSurface) || EqualRect(&rcCrop, &rcSurface)) {
+		rcCrop = rcSurface;
 		return false;
+	}
+
+	return true;
+}
 
-	PushVideo(rect);
-	m_pSurface->UnlockRect();
+// Returns false if the whole frame has to be treated as changed
+bool MagnifierCapture::GetDirtyRects(const RGNDATA *dirtyRegion, const RECT &rcCrop, ST_DirtyRectList &list)
+{
+	bool bSameCrop = !!EqualRect(&rcCrop, &m_rcLastCrop);
+	m_rcLastCrop = rcCrop;
+
+	if (!bSameCrop || !dirtyRegion || dirtyRegion->rdh.iType != RDH_RECTANGLES || !dirtyRegion->rdh.nCount)
+		return false;
+
+	LONG width = rcCrop.right - rcCrop.left;
+	LONG height = rcCrop.bottom - rcCrop.top;
+	const RECT *rects = (const RECT *)dirtyRegion->Buffer;
+
+	ClearDirtyRects(list);
+	for (DWORD i = 0; i < dirtyRegion->rdh.nCount; i++) {
+		const RECT &rc = rects[i];
+		ST_DirtyRect item;
+		item.left = (int32_t)(rc.left - rcCrop.left);
+		item.top = (int32_t)(rc.top - rcCrop.top);
+		item.right = (int32_t)(rc.right - rcCrop.left);
+		item.bottom = (int32_t)(rc.bottom - rcCrop.top);
+		AddDirtyRect(list, item, (int32_t)width, (int32_t)height);
+	}
 
 	return true;
 }
 
-void MagnifierCapture::PushVideo(D3DLOCKED_RECT &rect)
+static uint64_t HashNV12(const ST_MagnifierFrame *vf)
+{
+	ST_HashState state;
+	HashInit(state);
+
+	for (UINT y = 0; y < vf->height; y++)
+		HashRow(state, vf->planes[0] + size_t(vf->pitches[0]) * y, vf->width);
+	for (UINT y = 0; y < (vf->height + 1) / 2; y++)
+		HashRow(state, vf->planes[1] + size_t(vf->pitches[1]) * y, (vf->width + 1) / 2 * 2);
+
+	return HashFinal(state);
+}
+
+void MagnifierCapture::PushVideo(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty)
 {
-	assert(rect.Pitch == m_nPitch);
 	assert(GetCurrentThreadId() == m_dwThreadID);
 
-	size_t size = size_t(rect.Pitch) * size_t(m_uHeight);
-	std::shared_ptr<uint8_t> data = GetIdleFrame();
-	if (!data)
-		data = std::shared_ptr<uint8_t>(new uint8_t[size]);
+	if (m_uOutputWidth && m_uOutputHeight && (m_uOutputWidth != width || m_uOutputHeight != height)) {
+		PushVideoScaled(rect, width, height, dirty);
+		return;
+	}
 
-	memmove(data.get(), rect.pBits, size);
+	if (m_OutputFormat == MAG_OUTPUT_NV12) {
+		PushVideoNV12(rect, width, height, dirty);
+		return;
+	}
 
-	std::shared_ptr<MagnifierCapture> self = shared_from_this();
-	std::weak_ptr<MagnifierCapture> wself(self);
-	std::shared_ptr<ST_MagnifierFrame> vf(new ST_MagnifierFrame(), [wself](ST_MagnifierFrame *frame) {
-		auto self = wself.lock();
-		if (self) {
-			ST_MagnifierFrame vf = *frame;
-			self->PushTask([self, vf]() {
-				if (vf.width != self->m_uWidth || vf.height != self->m_uHeight || vf.pitch != self->m_nPitch)
-					return;
-
-				assert(GetCurrentThreadId() == self->m_dwThreadID);
-				if (self->m_IdleList.size() < MAX_IDLE_FRAME_COUNT)
-					self->m_IdleList.push(vf.data);
-			});
-		}
+	// keeping the surface pitch makes no sense for a sub-rectangle
+	MagPitchPolicy policy = m_PitchPolicy;
+	if (policy == MAG_PITCH_SOURCE && width != m_uWidth)
+		policy = MAG_PITCH_PACKED;
+
+	UINT rowBytes = width * 4;
+	INT pitch = CalcFramePitch(rowBytes, rect.Pitch, policy);
+	size_t size = size_t(pitch) * size_t(height);
+
+	const uint8_t *src = (const uint8_t *)rect.pBits;
+	bool bHash = m_bFrameHash || m_bSkipDuplicate;
+	uint64_t prevHash = m_pLastFrame ? m_pLastFrame->hash : 0;
+	bool bIncremental = dirty && m_pLastFrame && m_pLastFrame->width == width && m_pLastFrame->height == height && m_pLastFrame->pitch == pitch;
+	bool bInPlace = bIncremental && m_pLastFrame->IsExclusive();
+
+	ComPtr<ST_MagnifierFrame> vf;
+	if (bInPlace)
+		vf = m_pLastFrame;
+	else
+		vf.Set(m_pFramePool->Acquire(size));
+
+	vf->width = width;
+	vf->height = height;
+	vf->pitch = pitch;
+	vf->rowAlignment = CalcRowAlignment(vf->data, pitch, (UINT)vf->alignment);
+	vf->planes[0] = vf->data;
+	vf->pitches[0] = pitch;
+
+	vf->hash = 0;
+	if (bInPlace) {
+		// consumer already dropped the previous frame, only the changed rects have to be refreshed
+		CopyDirtyRects32(vf->data, pitch, src, rect.Pitch, *dirty);
+		if (m_bTileDamage)
+			UpdateTileDamage(vf, nullptr, 0, dirty, false);
+		if (bHash)
+			vf->hash = HashPlane(vf->data, pitch, rowBytes, height);
+	} else if (m_bTileDamage) {
+		UpdateTileDamage(vf, src, rect.Pitch, nullptr, bHash);
+	} else if (bHash) {
+		vf->hash = CopyHashPlane(vf->data, pitch, src, rect.Pitch, rowBytes, height);
+	} else {
+		bool bStream = UseStreamingCopy(size);
+		RunBands(height, 1, size, [&](UINT begin, UINT end) {
+			uint8_t *dst = vf->data + size_t(pitch) * begin;
+			if (bStream)
+				StreamPlane(dst, pitch, src + size_t(rect.Pitch) * begin, rect.Pitch, rowBytes, end - begin);
+			else
+				CopyPlane(dst, pitch, src + size_t(rect.Pitch) * begin, rect.Pitch, rowBytes, end - begin);
+		});
+	}
 
-		delete frame;
+	PublishVideo(vf, bIncremental ? dirty : nullptr, prevHash, bInPlace);
+}
+
+// MAG_OUTPUT_NV12: one pass from the locked surface into the NV12 frame, no BGRA copy is written or read again
+void MagnifierCapture::PushVideoNV12(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty)
+{
+	uint64_t prevHash = m_pLastFrame ? m_pLastFrame->hash : 0;
+	bool bIncremental = dirty && m_pLastFrame && m_pLastFrame->width == width && m_pLastFrame->height == height;
+
+	ComPtr<ST_MagnifierFrame> vf = AcquireYuvFrame(MAG_YUV_NV12, width, height);
+	RunBands(height, 2, size_t(width) * 4 * height, [&](UINT begin, UINT end) {
+		ConvertBGRAToYuv((const uint8_t *)rect.pBits, rect.Pitch, width, height, begin, end, MAG_YUV_NV12, vf->planes, vf->pitches, m_OutputCoefs);
 	});
 
-	vf->width = m_uWidth;
-	vf->height = m_uHeight;
-	vf->pitch = rect.Pitch;
-	vf->data = data;
+	// the NV12 output is 1.5 bytes per pixel, cheaper to hash than the source
+	vf->hash = (m_bFrameHash || m_bSkipDuplicate) ? HashNV12(vf) : 0;
 
-	std::lock_guard<std::recursive_mutex> autoLock(m_lockFrame);
-	m_vFrameList.clear();
-	m_vFrameList.push_back(vf);
-	m_dwPreCaptureTime = GetTickCount64();
+	PublishVideo(vf, bIncremental ? dirty : nullptr, prevHash, false);
 }
 
-void MagnifierCapture::ClearVideo()
+// Output size differs from the captured size: the scaler reads the locked surface directly, no full size copy is made
+void MagnifierCapture::PushVideoScaled(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty)
 {
-	{
-		std::lock_guard<std::recursive_mutex> autoLock(m_lockFrame);
-		m_vFrameList.clear();
+	UINT outWidth = m_uOutputWidth;
+	UINT outHeight = m_uOutputHeight;
+	m_Scaler.Prepare(m_ScaleFilter, width, height, outWidth, outHeight);
+
+	MagPitchPolicy policy = (m_PitchPolicy == MAG_PITCH_SOURCE) ? MAG_PITCH_PACKED : m_PitchPolicy;
+	INT pitch = CalcFramePitch(outWidth * 4, 0, policy);
+
+	bool bHash = m_bFrameHash || m_bSkipDuplicate;
+	uint64_t prevHash = m_pLastFrame ? m_pLastFrame->hash : 0;
+	bool bIncremental = dirty && m_pLastFrame && m_pLastFrame->width == outWidth && m_pLastFrame->height == outHeight;
+
+	// one output pixel reads up to one source pixel beyond its footprint
+	ST_DirtyRectList scaled;
+	if (bIncremental) {
+		int32_t margin = 1 + (int32_t)((outWidth + width - 1) / width + (outHeight + height - 1) / height);
+		ScaleDirtyRects(scaled, *dirty, (int32_t)width, (int32_t)height, (int32_t)outWidth, (int32_t)outHeight, margin);
 	}
 
-	assert(GetCurrentThreadId() == m_dwThreadID);
-	while (!m_IdleList.empty()) {
-		m_IdleList.pop();
+	ComPtr<ST_MagnifierFrame> vf;
+	vf.Set(m_pFramePool->Acquire(size_t(pitch) * outHeight));
+	vf->width = outWidth;
+	vf->height = outHeight;
+	vf->pitch = pitch;
+	vf->rowAlignment = CalcRowAlignment(vf->data, pitch, (UINT)vf->alignment);
+	vf->planes[0] = vf->data;
+	vf->pitches[0] = pitch;
+
+	RunBands(outHeight, 1, size_t(width) * 4 * height, [&](UINT begin, UINT end) { m_Scaler.Scale32Rows((const uint8_t *)rect.pBits, rect.Pitch, vf->data, pitch, begin, end); });
+
+	if (m_OutputFormat == MAG_OUTPUT_NV12) {
+		ComPtr<ST_MagnifierFrame> yuv = AcquireYuvFrame(MAG_YUV_NV12, outWidth, outHeight);
+		RunBands(outHeight, 2, size_t(outWidth) * 4 * outHeight, [&](UINT begin, UINT end) {
+			ConvertBGRAToYuv(vf->data, pitch, outWidth, outHeight, begin, end, MAG_YUV_NV12, yuv->planes, yuv->pitches, m_OutputCoefs);
+		});
+		yuv->hash = bHash ? HashNV12(yuv) : 0;
+		PublishVideo(yuv, bIncremental ? &scaled : nullptr, prevHash, false);
+		return;
 	}
+
+	if (m_bTileDamage)
+		UpdateTileDamage(vf, nullptr, 0, nullptr, false);
+
+	vf->hash = bHash ? HashPlane(vf->data, pitch, outWidth * 4, outHeight) : 0;
+	PublishVideo(vf, bIncremental ? &scaled : nullptr, prevHash, false);
 }
 
-std::shared_ptr<uint8_t> MagnifierCapture::GetIdleFrame()
+// dirty is set if only those rects changed since m_pLastFrame, bInPlace if vf is m_pLastFrame updated in place
+void MagnifierCapture::PublishVideo(const ComPtr<ST_MagnifierFrame> &vf, const ST_DirtyRectList *dirty, uint64_t prevHash, bool bInPlace)
 {
-	assert(GetCurrentThreadId() == m_dwThreadID);
+	UINT width = vf->width;
+	UINT height = vf->height;
+
+	ULONGLONG now = GetTickCount64();
+	bool bSameGeometry = m_pLastFrame && m_pLastFrame->width == width && m_pLastFrame->height == height;
+	if (m_bSkipDuplicate && bSameGeometry && vf->hash == prevHash) {
+		// nothing new for the consumer, vf goes back to the pool (or already is the published frame)
+		++m_pLastFrame->repeatCount;
+		m_pLastFrame->timestamp = now;
+		++m_nDuplicateFrames;
+		m_dwPreCaptureTime = now;
+		return;
+	}
 
-	if (m_IdleList.empty())
-		return nullptr;
+	// the previous frame is still waiting in the mailbox, its changes must not get lost
+	bool bMergePrev = !bInPlace && m_pLastFrame && m_FrameMailbox.HasFresh();
 
-	auto ret = m_IdleList.front();
-	m_IdleList.pop();
-	return ret;
+	if (dirty) {
+		vf->dirty = *dirty;
+		if (bMergePrev)
+			MergeDirtyRects(vf->dirty, m_pLastFrame->dirty, (int32_t)width, (int32_t)height);
+	} else {
+		SetFullDirty(vf->dirty, (int32_t)width, (int32_t)height);
+	}
+
+	// an in-place frame still carries the tiles of a stage that has been switched off since
+	if (!m_bTileDamage || vf->format != D3DFMT_A8R8G8B8)
+		vf->ClearTileDamage();
+
+	if (m_bTileDamage && bMergePrev && m_pLastFrame->damage.size() == vf->damage.size()) {
+		for (size_t i = 0; i < vf->damage.size(); i++)
+			vf->damage[i] |= m_pLastFrame->damage[i];
+
+		vf->identical = vf->identical && m_pLastFrame->identical;
+	}
+
+	vf->repeatCount = 0;
+	vf->timestamp = now;
+	vf->converted = nullptr;
+	if (m_YuvFormat != MAG_YUV_NONE && vf->format == D3DFMT_A8R8G8B8)
+		vf->converted = ConvertVideo(vf);
+
+	vf->pyramidBuffer = nullptr;
+	vf->levelCount = 0;
+	if (m_uPyramidLevels && vf->format == D3DFMT_A8R8G8B8)
+		BuildPyramid(vf);
+
+	m_pLastFrame = vf;
+	m_FrameMailbox.Publish(vf);
+	++m_nPublishedFrames;
+	m_dwPreCaptureTime = now;
+}
+
+// Hashes every tile of the frame and compares it with the previous frame.
+// If src is set the frame is copied from it band by band, each band is hashed while it is still in cache.
+// If dirty is set only bands touched by a dirty rect are hashed again.
+// If bHash is set the whole frame hash is computed in the same copy, on the magnifier thread only.
+void MagnifierCapture::UpdateTileDamage(ST_MagnifierFrame *vf, const uint8_t *src, INT srcPitch, const ST_DirtyRectList *dirty, bool bHash)
+{
+	UINT tileSize = m_uTileSize;
+	UINT tilesX = (vf->width + tileSize - 1) / tileSize;
+	UINT tilesY = (vf->height + tileSize - 1) / tileSize;
+	size_t count = size_t(tilesX) * tilesY;
+
+	bool bComparable = (m_vTileHashes.size() == count && m_uTileHashWidth == vf->width && m_uTileHashHeight == vf->height && m_uTileHashSize == tileSize);
+
+	vf->tileSize = tileSize;
+	vf->tilesX = tilesX;
+	vf->tilesY = tilesY;
+	vf->tileHashes.resize(count);
+	vf->damage.assign((count + 7) / 8, 0);
+
+	ST_HashState frameHash;
+	HashInit(frameHash);
+
+	// rows [begin, end) cover whole tile rows, the last one may be shorter
+	auto hashBands = [&](UINT begin, UINT end) {
+		for (UINT ty = begin / tileSize; ty * tileSize < end; ty++) {
+			UINT y = ty * tileSize;
+			UINT rows = (vf->height - y < tileSize) ? (vf->height - y) : tileSize;
+			uint8_t *band = vf->data + size_t(vf->pitch) * y;
+			uint64_t *hashes = vf->tileHashes.data() + size_t(ty) * tilesX;
+
+			if (src && bHash)
+				CopyHashRows(frameHash, band, vf->pitch, src + size_t(srcPitch) * y, srcPitch, vf->width * 4, rows);
+			else if (src)
+				CopyPlane(band, vf->pitch, src + size_t(srcPitch) * y, srcPitch, vf->width * 4, rows);
+
+			bool bTouched = !dirty || !bComparable;
+			for (uint32_t i = 0; !bTouched && i < dirty->count; i++)
+				bTouched = dirty->rects[i].top < (int32_t)(y + rows) && dirty->rects[i].bottom > (int32_t)y;
+
+			if (bTouched)
+				HashTileBand32(band, vf->pitch, vf->width, rows, tileSize, hashes);
+			else
+				memcpy(hashes, m_vTileHashes.data() + size_t(ty) * tilesX, tilesX * sizeof(uint64_t));
+		}
+	};
+
+	// the frame hash is one running state over all rows
+	if (src && bHash)
+		hashBands(0, vf->height);
+	else
+		RunBands(vf->height, tileSize, size_t(vf->pitch) * vf->height, hashBands);
+
+	bool bIdentical = bComparable;
+	for (size_t index = 0; index < count; index++) {
+		if (!bComparable || vf->tileHashes[index] != m_vTileHashes[index]) {
+			vf->damage[index / 8] |= uint8_t(1 << (index % 8));
+			bIdentical = false;
+		}
+	}
+
+	vf->identical = bIdentical;
+	if (src && bHash)
+		vf->hash = HashFinal(frameHash);
+
+	m_vTileHashes = vf->tileHashes;
+	m_uTileHashWidth = vf->width;
+	m_uTileHashHeight = vf->height;
+	m_uTileHashSize = tileSize;
+}
+
+bool MagnifierCapture::UseStreamingCopy(size_t bytes) const
+{
+	switch (m_CopyMode) {
+	case MAG_COPY_TEMPORAL:
+		return false;
+
+	case MAG_COPY_STREAMING:
+		return true;
+
+	default:
+		// the conversion and the pyramid read the frame right after the copy, it should still be in cache for them
+		return bytes >= MAG_STREAM_COPY_MIN && m_YuvFormat == MAG_YUV_NONE && !m_uPyramidLevels;
+	}
+}
+
+// Stages touching at least MAG_BAND_MIN_BYTES are split into row bands on the shared pool, rowBegin of every band is a multiple of align
+template <typename F> void MagnifierCapture::RunBands(UINT rows, UINT align, size_t bytes, F &&func)
+{
+	if (bytes >= MAG_BAND_MIN_BYTES)
+		m_BandQueue.Run(rows, align, func);
+	else
+		func(0u, rows);
+}
+
+ComPtr<ST_MagnifierFrame> MagnifierCapture::AcquireYuvFrame(MagYuvFormat format, UINT width, UINT height)
+{
+	size_t offsets[3];
+	INT pitches[3];
+	size_t size = CalcYuvLayout(format, width, height, offsets, pitches);
+
+	ComPtr<ST_MagnifierFrame> yuv;
+	yuv.Set(m_pYuvPool->Acquire(size));
+
+	yuv->format = (format == MAG_YUV_NV12) ? MAG_FMT_NV12 : MAG_FMT_I420;
+	yuv->width = width;
+	yuv->height = height;
+	yuv->pitch = pitches[0];
+	yuv->rowAlignment = CalcRowAlignment(yuv->data, pitches[0], (UINT)yuv->alignment);
+	for (int i = 0; i < 3; i++) {
+		yuv->planes[i] = pitches[i] ? yuv->data + offsets[i] : nullptr;
+		yuv->pitches[i] = pitches[i];
+	}
+
+	return yuv;
+}
+
+// Converts the BGRA frame into a frame of the YUV pool, the source is still in cache after the readback
+ComPtr<ST_MagnifierFrame> MagnifierCapture::ConvertVideo(const ST_MagnifierFrame *vf)
+{
+	ComPtr<ST_MagnifierFrame> yuv = AcquireYuvFrame(m_YuvFormat, vf->width, vf->height);
+	yuv->dirty = vf->dirty;
+	yuv->hash = vf->hash;
+	yuv->timestamp = vf->timestamp.load();
+
+	RunBands(vf->height, 2, size_t(vf->width) * 4 * vf->height, [&](UINT begin, UINT end) {
+		ConvertBGRAToYuv(vf->data, vf->pitch, vf->width, vf->height, begin, end, m_YuvFormat, yuv->planes, yuv->pitches, m_YuvCoefs);
+	});
+	return yuv;
+}
+
+// Level 0 is read from the frame while it is still in cache after the readback, every further level from the previous one
+void MagnifierCapture::BuildPyramid(ST_MagnifierFrame *vf)
+{
+	size_t offsets[MAG_MAX_PYRAMID_LEVELS];
+	size_t size = 0;
+	UINT count = 0;
+	UINT width = vf->width;
+	UINT height = vf->height;
+
+	for (; count < m_uPyramidLevels && (width > 1 || height > 1); count++) {
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
+
+		ST_FrameLevel &level = vf->levels[count];
+		level.width = width;
+		level.height = height;
+		level.pitch = (INT)AlignUp(size_t(width) * 4, MAG_CACHE_LINE);
+		offsets[count] = size;
+		size += size_t(level.pitch) * height;
+	}
+
+	if (!count)
+		return;
+
+	vf->pyramidBuffer.Set(m_pPyramidPool->Acquire(size));
+
+	const uint8_t *src = vf->data;
+	INT srcPitch = vf->pitch;
+	UINT srcWidth = vf->width;
+	UINT srcHeight = vf->height;
+	for (UINT i = 0; i < count; i++) {
+		ST_FrameLevel &level = vf->levels[i];
+		level.data = vf->pyramidBuffer->data + offsets[i];
+
+		// output rows [begin, end) read the source rows [2 * begin, 2 * end)
+		RunBands(level.height, 1, size_t(srcWidth) * 4 * srcHeight, [&](UINT begin, UINT end) {
+			UINT rows = (srcHeight > 1) ? 2 * (end - begin) : 1;
+			Downsample2x32(src + size_t(srcPitch) * 2 * begin, srcPitch, srcWidth, rows, level.data + size_t(level.pitch) * begin, level.pitch);
+		});
+
+		src = level.data;
+		srcPitch = level.pitch;
+		srcWidth = level.width;
+		srcHeight = level.height;
+	}
+
+	vf->levelCount = count;
+}
+
+void MagnifierCapture::ClearVideo()
+{
+	assert(GetCurrentThreadId() == m_dwThreadID);
+	m_FrameMailbox.Publish(nullptr);
+	m_pLastFrame = nullptr;
+	m_vTileHashes.clear();
+	m_bSkippedPresent = false;
+	m_bSkippedFull = false;
+	ClearDirtyRects(m_SkippedDirty);
+
+	m_pFramePool->Clear();
+	m_pYuvPool->Clear();
+	m_pPyramidPool->Clear();
+	m_pStagingPool->Clear();
 }
@@ -6,13 +6,25 @@
 #include <process.h>
 #include <wincodec.h>
 #include <magnification.h>
-#include <functional>
 #include <assert.h>
 #include <d3d9.h>
 #include <detours.h>
-#include <queue>
 #include <atomic>
 #include "ComPtr.hpp"
+#include "FrameMailbox.hpp"
+#include "FramePool.hpp"
+#include "TaskQueue.hpp"
+#include "LatestValue.hpp"
+#include "FrameCopy.h"
+#include "DirtyRects.h"
+#include "FrameHash.h"
+#include "ColorConvert.h"
+#include "FrameScale.h"
+#include "PixelFormat.h"
+#include "BandPool.h"
+#include "CaptureScheduler.h"
+#include "StagingRing.h"
+#include "D3D9Staging.h"
 
 #define DEBUG_MAG_WINDOW 0
 
@@ -27,12 +39,108 @@ using ResetEx_t = HRESULT(STDMETHODCALLTYPE *)(IDirect3DDevice9 *, D3DPRESENT_PA
 比如(0, 0, 1920, 1080),  但是修改为1921，1919， 1084， 就可以捕获画面了。原因不明
 */
 
-struct ST_MagnifierFrame {
-	const D3DFORMAT format = D3DFMT_A8R8G8B8;
+#define MAG_MAX_PYRAMID_LEVELS 8
+#define MAG_DEFAULT_MAX_STALENESS 100 // in ms, see SetDemandCapture
+#define MAG_TASK_QUEUE_SIZE 256 // pending setter tasks, PushTask waits for the magnifier thread when it is full
+
+#define MAG_FMT_NV12 ((D3DFORMAT)MAKEFOURCC('N', 'V', '1', '2'))
+#define MAG_FMT_I420 ((D3DFORMAT)MAKEFOURCC('I', '4', '2', '0'))
+
+enum MagOutputFormat {
+	MAG_OUTPUT_BGRA = 0, // D3DFMT_A8R8G8B8 frames
+	MAG_OUTPUT_NV12,     // MAG_FMT_NV12 frames converted straight from the locked surface
+};
+
+struct ST_CaptureStats {
+	uint64_t publishedFrames = 0;
+	uint64_t duplicateFrames = 0;  // identical to the previous frame, not published
+	uint64_t readbacks = 0;        // presents copied back from the GPU
+	uint64_t avoidedReadbacks = 0; // presents skipped by SetDemandCapture because the last frame was not taken yet
+	uint64_t coalescedUpdates = 0; // SetFPS / SetCaptureRegion / SetExcludeWindow values replaced before a tick applied them
+	ST_BandQueueStats bands;      // pixel stages split over the shared worker pool
+	ST_ScheduleStats schedule;    // lateness of the capture ticks against their deadlines
+	ST_StagingStats staging;      // readback ring, see SetReadbackLatency
+};
+
+// Capture ticks per second as num / den, e.g. 30000 / 1001 for 29.97
+struct ST_FrameRate {
+	UINT num = 0;
+	UINT den = 1;
+};
+
+// Settings the UI may change many times per frame, the magnifier thread applies the newest values once per tick
+struct ST_CaptureControls {
+	LatestValue<ST_FrameRate> frameRate;
+	LatestValue<RECT> captureRegion;
+	LatestValue<std::vector<HWND>> excludeWindows;
+};
+
+// What CaptureDX9 knew about a present when it was copied into a staging slot, used when the slot is read
+struct ST_StagingMeta {
+	RECT rcCrop = {0};
+	bool bPartial = false;
+	ST_DirtyRectList dirty;
+};
+
+// One reduced copy of a BGRA frame, see SetPyramidLevels
+struct ST_FrameLevel {
+	uint8_t *data = nullptr;
+	UINT width = 0;
+	UINT height = 0;
+	INT pitch = 0;
+};
+
+// data and capacity come from PooledFrame, release the last reference from any thread to recycle it
+struct ST_MagnifierFrame : public PooledFrame {
+	D3DFORMAT format = D3DFMT_A8R8G8B8; // or MAG_FMT_NV12 / MAG_FMT_I420
 	UINT width = 0;
 	UINT height = 0;
 	INT pitch = 0;
-	std::shared_ptr<uint8_t> data = nullptr;
+	UINT rowAlignment = 0;  // every row of data starts on this boundary
+	ST_DirtyRectList dirty; // changed since the previous frame, in frame coordinates
+	uint64_t hash = 0;      // of the visible pixels, row padding excluded. Filled when enabled by SetFrameHash
+
+	// Inside data, planes[0] is data for BGRA. Y, U, V or Y, UV for YUV formats
+	uint8_t *planes[3] = {nullptr, nullptr, nullptr};
+	INT pitches[3] = {0, 0, 0};
+
+	// Updated after publishing when duplicate suppression drops identical captures
+	std::atomic<uint32_t> repeatCount = {0};
+	std::atomic<ULONGLONG> timestamp = {0}; // GetTickCount64 of the latest capture showing this content
+
+	// Filled when tile damage is enabled, see SetTileDamage. Zero and empty otherwise
+	UINT tileSize = 0;
+	UINT tilesX = 0;
+	UINT tilesY = 0;
+	bool identical = false; // no tile changed since the previous frame
+	std::vector<uint64_t> tileHashes;
+	std::vector<uint8_t> damage; // one bit per tile, row major
+
+	// Same picture as NV12/I420 when enabled by SetColorConversion, the metadata above applies to it
+	ComPtr<ST_MagnifierFrame> converted;
+
+	// levels[i] is 1 / 2^(i + 1) of the frame, all levels live in pyramidBuffer
+	UINT levelCount = 0;
+	ST_FrameLevel levels[MAG_MAX_PYRAMID_LEVELS];
+	ComPtr<PooledFrame> pyramidBuffer;
+
+	void ClearTileDamage()
+	{
+		tileSize = 0;
+		tilesX = 0;
+		tilesY = 0;
+		identical = false;
+		tileHashes.clear();
+		damage.clear();
+	}
+
+	void Reset() override
+	{
+		converted = nullptr;
+		pyramidBuffer = nullptr;
+		levelCount = 0;
+		ClearTileDamage();
+	}
 };
 
 class MagnifierCapture : public std::enable_shared_from_this<MagnifierCapture> {
@@ -42,52 +150,149 @@ public:
 	~MagnifierCapture();
 
 	void SetFPS(int fps);
+	// Fractional rates such as 30000 / 1001, every tick has an absolute deadline so the rate does not drift.
+	// Reduced and clamped to MAG_SCHEDULE_MAX_NUM / MAG_SCHEDULE_MAX_DEN, a zero num or den is ignored
+	void SetFrameRate(UINT num, UINT den = 1);
 	void SetExcludeWindow(std::vector<HWND> filter);
 	void SetCaptureRegion(RECT rcScreen);
+	// Relative to the captured region, only this part is read back. Empty rect for the whole region
+	void SetCropRegion(RECT rcCrop);
+	// Hash every frame in tiles and publish a damage bitmap against the previous frame
+	void SetTileDamage(bool enable, UINT tileSize = 64);
+	// Compute ST_MagnifierFrame::hash in the same pass as the readback copy
+	void SetFrameHash(bool enable);
+	// Identical frames are not published again, only repeatCount and timestamp of the last one are updated
+	void SetDuplicateSuppression(bool enable);
+	// Read a present back only when the consumer took the last frame, or the untaken frame is older than maxStaleness ms.
+	// Changes of the skipped presents are carried into the dirty rects of the next frame. With a readback latency the first
+	// readback after skipping drops the older copies in the ring and publishes that present in full, without the latency
+	void SetDemandCapture(bool enable, UINT maxStaleness = MAG_DEFAULT_MAX_STALENESS);
+	// Frames are scaled to this size right from the readback, 0 x 0 keeps the captured size
+	void SetOutputSize(UINT width, UINT height, MagScaleFilter filter = MAG_SCALE_AREA);
+	// Build this many 2x box filtered levels of every published BGRA frame, 0 to disable
+	void SetPyramidLevels(UINT count);
+	// Format of the published frames. Tile damage and SetColorConversion only apply to MAG_OUTPUT_BGRA
+	void SetOutputFormat(MagOutputFormat format, MagColorMatrix matrix = MAG_MATRIX_BT709, MagColorRange range = MAG_RANGE_LIMITED);
+	// Attach a YUV copy of every published frame, MAG_YUV_NONE to disable
+	void SetColorConversion(MagYuvFormat format, MagColorMatrix matrix = MAG_MATRIX_BT709, MagColorRange range = MAG_RANGE_LIMITED);
+	void SetFramePoolDepth(size_t depth);
+	void SetFrameAlignment(bool bPageAligned, MagPitchPolicy policy);
+	// Temporal or non-temporal stores for the readback copy of BGRA frames
+	void SetCopyMode(MagCopyMode mode);
+	// Published frames are this many presents behind, in exchange the present thread does not wait for the GPU copy.
+	// 0 (default) reads every present back right away, at most MAG_MAX_READBACK_LATENCY
+	void SetReadbackLatency(UINT frames);
+	// Threads of the shared worker pool (see MagnifierCore::SetWorkerThreads) one large frame may occupy, the magnifier thread included.
+	// 1 keeps every pixel stage on the magnifier thread, 0 (default) for no limit. Without SetWorkerThreads there are no workers to share
+	void SetBandThreads(UINT threads);
+
+	ST_CaptureStats GetCaptureStats() const;
+	ST_FramePoolStats GetFramePoolStats() const;
 
 	// Second value: bool bCaptureNormalRunning
-	std::pair<std::shared_ptr<ST_MagnifierFrame>, bool> PopVideo();
+	// Should be called from one consumer thread only
+	std::pair<ComPtr<ST_MagnifierFrame>, bool> PopVideo();
 
 protected:
+	// Capture whose magnifier thread is calling, nullptr on every other thread. The hooks use it without lock or reference,
+	// the capture outlives its thread
+	static MagnifierCapture *GetCurrent() { return s_pCurrent; }
+
 	static LRESULT __stdcall HostWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 	static unsigned __stdcall MagnifierThread(void *pParam);
 
-	MagnifierCapture();
+	explicit MagnifierCapture(BandPool *pool);
 	bool RegisterMagClass();
 
 	DWORD Start();
 	void Stop();
 
 	void MagnifierThreadInner();
+	void RunMessageLoop();
 	bool SetupMagnifier(HINSTANCE hInst);
 	void CaptureVideo();
 
-	void PushTask(std::function<void()> func);
+	void PushTask(InlineTask task);
 	void RunTask();
 
-	bool OnPresentEx(IDirect3DDevice9Ex *device);
+	template <typename T> void SetControl(LatestValue<T> &control, T value);
+	void ApplyControls();
+
+	bool OnPresentEx(IDirect3DDevice9Ex *device, const RGNDATA *dirtyRegion);
 	void FreeDX();
 	void CheckFree(IDirect3DDevice9Ex *device);
 	bool InitDX9(IDirect3DDevice9Ex *device);
-	bool CaptureDX9();
+	bool CaptureDX9(const RGNDATA *dirtyRegion);
+	bool NeedReadback(ULONGLONG now) const;
 	bool InitTextureInfo(IDirect3DDevice9Ex *device);
 	bool CreateCopySurface(IDirect3DDevice9Ex *device);
 
-	void PushVideo(D3DLOCKED_RECT &rect);
+	bool GetCropRect(RECT &rcCrop);
+	bool GetDirtyRects(const RGNDATA *dirtyRegion, const RECT &rcCrop, ST_DirtyRectList &list);
+	void PushVideo(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty);
+	void PushVideoNV12(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty);
+	void PushVideoScaled(D3DLOCKED_RECT &rect, UINT width, UINT height, const ST_DirtyRectList *dirty);
+	void PublishVideo(const ComPtr<ST_MagnifierFrame> &vf, const ST_DirtyRectList *dirty, uint64_t prevHash, bool bInPlace);
+	void UpdateTileDamage(ST_MagnifierFrame *vf, const uint8_t *src, INT srcPitch, const ST_DirtyRectList *dirty, bool bHash);
+	ComPtr<ST_MagnifierFrame> AcquireYuvFrame(MagYuvFormat format, UINT width, UINT height);
+	ComPtr<ST_MagnifierFrame> ConvertVideo(const ST_MagnifierFrame *vf);
+	bool UseStreamingCopy(size_t bytes) const;
+	template <typename F> void RunBands(UINT rows, UINT align, size_t bytes, F &&func);
+	void BuildPyramid(ST_MagnifierFrame *vf);
 	void ClearVideo();
-	std::shared_ptr<uint8_t> GetIdleFrame();
 
 private:
-	std::recursive_mutex m_lockTask;
-	std::vector<std::function<void()>> m_vTaskList;
+	static thread_local MagnifierCapture *s_pCurrent;
+
+	MpscQueue<InlineTask, MAG_TASK_QUEUE_SIZE> m_TaskQueue;
+	std::atomic<bool> m_bTaskPosted = {false}; // MSG_MAG_TASK is on its way, RunTask has not started draining
+	ST_CaptureControls m_Controls;
+	std::atomic<bool> m_bTicking = {false}; // the capture scheduler runs and applies m_Controls
+	std::atomic<uint64_t> m_nCoalescedUpdates = 0;
 
-	std::recursive_mutex m_lockFrame;
-	std::vector<std::shared_ptr<ST_MagnifierFrame>> m_vFrameList;
+	FrameMailbox<ComPtr<ST_MagnifierFrame>> m_FrameMailbox;
+	ComPtr<FramePool<ST_MagnifierFrame>> m_pFramePool;
+	ComPtr<FramePool<ST_MagnifierFrame>> m_pYuvPool;
+	ComPtr<FramePool<PooledFrame>> m_pPyramidPool;
+	ComPtr<FramePool<PooledFrame>> m_pStagingPool; // BGRA copy of backbuffers in other formats
 	std::atomic<ULONGLONG> m_dwPreCaptureTime = 0;
+	std::atomic<uint64_t> m_nPublishedFrames = 0;
+	std::atomic<uint64_t> m_nDuplicateFrames = 0;
+	std::atomic<uint64_t> m_nReadbacks = 0;
+	std::atomic<uint64_t> m_nAvoidedReadbacks = 0;
 
 	// Accessed in magnifier thread
+	CaptureScheduler m_Scheduler; // GetStats from any thread
 	RECT m_rcCaptureScreen = {0};
-	std::queue<std::shared_ptr<uint8_t>> m_IdleList;
+	RECT m_rcCrop = {0};
+	RECT m_rcLastCrop = {0};
+	ComPtr<ST_MagnifierFrame> m_pLastFrame; // target of dirty rect updates
+	bool m_bFrameHash = false;
+	bool m_bSkipDuplicate = false;
+	bool m_bDemandCapture = false;
+	UINT m_uMaxStaleness = MAG_DEFAULT_MAX_STALENESS;
+	ULONGLONG m_dwLastReadback = 0;
+	bool m_bSkippedPresent = false; // since the last readback, its changes are in m_SkippedDirty
+	bool m_bSkippedFull = false;    // a skipped present changed the whole frame
+	ST_DirtyRectList m_SkippedDirty;
+	bool m_bTileDamage = false;
+	UINT m_uTileSize = 64;
+	UINT m_uTileHashWidth = 0;
+	UINT m_uTileHashHeight = 0;
+	UINT m_uTileHashSize = 0;
+	std::vector<uint64_t> m_vTileHashes; // of the previous frame
+	MagPitchPolicy m_PitchPolicy = MAG_PITCH_CACHE_LINE;
+	MagCopyMode m_CopyMode = MAG_COPY_AUTO;
+	BandQueue m_BandQueue;
+	MagOutputFormat m_OutputFormat = MAG_OUTPUT_BGRA;
+	ST_YuvCoefs m_OutputCoefs; // of m_OutputFormat, m_YuvCoefs belongs to SetColorConversion
+	UINT m_uOutputWidth = 0;
+	UINT m_uOutputHeight = 0;
+	MagScaleFilter m_ScaleFilter = MAG_SCALE_AREA;
+	FrameScaler m_Scaler;
+	UINT m_uPyramidLevels = 0;
+	MagYuvFormat m_YuvFormat = MAG_YUV_NONE;
+	ST_YuvCoefs m_YuvCoefs;
 
 	DWORD m_dwThreadID = 0;
 	HANDLE m_hMagThread = 0;
@@ -95,8 +300,12 @@ private:
 	HWND m_hMagChild = 0;
 
 	IDirect3DDevice9Ex *m_pDeviceEx = nullptr; /* do not release */
-	ComPtr<IDirect3DSurface9> m_pSurface = nullptr;
+	D3D9StagingDevice m_StagingDevice;
+	StagingRing m_StagingRing;
+	UINT m_uReadbackLatency = 0;
+	ST_StagingMeta m_StagingMeta[MAG_MAX_READBACK_LATENCY + 1];
 	D3DFORMAT m_D3DFormat = D3DFMT_UNKNOWN;
+	MagPixelFormat m_SrcFormat = MAG_PIXEL_UNKNOWN;
 	UINT m_uWidth = 0;
 	UINT m_uHeight = 0;
 	INT m_nPitch = 0;
@@ -13,16 +13,16 @@ HRESULT STDMETHODCALLTYPE MagnifierCore ::PresentEx_Callback(IDirect3DDevice9Ex
 	OutputDebugStringA(buf);
 #endif
 
-	std::shared_ptr<MagnifierCapture> mag = MagnifierCore::Instance()->FindMagnifier(GetCurrentThreadId());
+	MagnifierCapture *mag = MagnifierCapture::GetCurrent();
 	if (mag)
-		mag->OnPresentEx(device);
+		mag->OnPresentEx(device, dirty_region);
 
 	return MagnifierCore::Instance()->m_pRealPresentEx(device, src_rect, dst_rect, override_window, dirty_region, flags);
 }
 
 HRESULT STDMETHODCALLTYPE MagnifierCore::Reset_Callback(IDirect3DDevice9 *device, D3DPRESENT_PARAMETERS *params)
 {
-	std::shared_ptr<MagnifierCapture> mag = MagnifierCore::Instance()->FindMagnifier(GetCurrentThreadId());
+	MagnifierCapture *mag = MagnifierCapture::GetCurrent();
 	if (mag)
 		mag->FreeDX();
 
@@ -31,7 +31,7 @@ HRESULT STDMETHODCALLTYPE MagnifierCore::Reset_Callback(IDirect3DDevice9 *device
 
 HRESULT STDMETHODCALLTYPE MagnifierCore::ResetEx_Callback(IDirect3DDevice9 *device, D3DPRESENT_PARAMETERS *params, D3DDISPLAYMODEEX *dmex)
 {
-	std::shared_ptr<MagnifierCapture> mag = MagnifierCore::Instance()->FindMagnifier(GetCurrentThreadId());
+	MagnifierCapture *mag = MagnifierCapture::GetCurrent();
 	if (mag)
 		mag->FreeDX();
 
@@ -62,6 +62,9 @@ bool MagnifierCore::Init()
 	if (m_bInited)
 		return true;
 
+	m_KernelLevel = SelectKernels(m_KernelLimit);
+	m_BandPool.SetThreads(m_uWorkerThreads);
+
 	if (!InitFuncAddr()) {
 		assert(false);
 		return false;
@@ -79,6 +82,7 @@ bool MagnifierCore::Init()
 void MagnifierCore::Uninit()
 {
 	ClearMagnifier();
+	m_BandPool.SetThreads(0);
 
 	if (m_bInited) {
 		UnHookFunc();
@@ -86,13 +90,26 @@ void MagnifierCore::Uninit()
 	}
 }
 
+void MagnifierCore::SetKernelLevel(MagCpuLevel level)
+{
+	m_KernelLimit = level;
+	m_KernelLevel = SelectKernels(level);
+}
+
+void MagnifierCore::SetWorkerThreads(UINT threads)
+{
+	m_uWorkerThreads = threads;
+	if (m_bInited)
+		m_BandPool.SetThreads(threads);
+}
+
 std::shared_ptr<MagnifierCapture> MagnifierCore::CreateMagnifier()
 {
 	assert(m_bInited);
 	if (!m_bInited)
 		return nullptr;
 
-	auto ret = std::shared_ptr<MagnifierCapture>(new MagnifierCapture());
+	auto ret = std::shared_ptr<MagnifierCapture>(new MagnifierCapture(&m_BandPool));
 	DWORD tid = ret->Start();
 
 	std::lock_guard<std::recursive_mutex> autoLock(m_lockList);
@@ -207,17 +224,6 @@ void MagnifierCore ::ClearMagnifier()
 	m_mapMagList.clear();
 }
 
-std::shared_ptr<MagnifierCapture> MagnifierCore ::FindMagnifier(DWORD tid)
-{
-	std::lock_guard<std::recursive_mutex> autoLock(m_lockList);
-
-	auto itr = m_mapMagList.find(tid);
-	if (itr != m_mapMagList.end())
-		return itr->second;
-	else
-		return nullptr;
-}
-
 bool MagnifierCore::HookFunc()
 {
 	DetourTransactionBegin();
@@ -1,5 +1,6 @@
 #pragma once
 #include "MagnifierCapture.h"
+#include "KernelDispatch.h"
 #include <map>
 
 class MagnifierCore {
@@ -14,6 +15,17 @@ public:
 	bool Init();
 	void Uninit();
 
+	// Caps the instruction set of the pixel kernels (for testing), applied now and at every Init
+	void SetKernelLevel(MagCpuLevel level);
+	MagCpuLevel GetKernelLevel() const { return m_KernelLevel; } // effective level after Init
+	std::vector<ST_KernelInfo> GetKernelInfo() const { return ::GetKernelInfo(); }
+
+	// Workers shared by the pixel stages of all captures, started by Init or right away after it.
+	// 0 (default) runs every stage on the thread of its capture. One less than the logical processors uses every core,
+	// the capture threads work on their own frames as well
+	void SetWorkerThreads(UINT threads);
+	ST_BandPoolStats GetWorkerStats() { return m_BandPool.GetStats(); }
+
 	std::shared_ptr<MagnifierCapture> CreateMagnifier();
 	void DestroyMagnifier(std::shared_ptr<MagnifierCapture> &);
 
@@ -21,7 +33,6 @@ protected:
 	MagnifierCore();
 
 	void ClearMagnifier();
-	std::shared_ptr<MagnifierCapture> FindMagnifier(DWORD tid);
 
 	bool RegisterTestClass();
 	bool InitFuncAddr();
@@ -30,6 +41,10 @@ protected:
 
 private:
 	bool m_bInited = false;
+	MagCpuLevel m_KernelLimit = MAG_CPU_AUTO;
+	MagCpuLevel m_KernelLevel = MAG_CPU_SCALAR;
+	UINT m_uWorkerThreads = 0;
+	BandPool m_BandPool; // outlives the captures in m_mapMagList
 
 	HMODULE m_hModule = 0; // need to free
 	PresentEx_t m_pRealPresentEx = nullptr;
@@ -0,0 +1,290 @@
+#include "PixelFormat.h"
+#include "CpuFeatures.h"
+#include "KernelDispatch.h"
+#include "FrameCopy.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MAG_PIXEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef MAG_ARCH_X86
+#include <immintrin.h>
+#endif
+
+#define HDR_KNEE 0.8f                      // linear up to here, above it compressed towards 1.0
+#define HDR_RANGE 0.2f                     // 1.0 - HDR_KNEE
+#define HDR_INV_RANGE 5.0f                 // 1.0 / HDR_RANGE
+#define HDR_MAX 65504.0f                   // largest finite half, also catches +inf
+#define HALF_EXP_REBIAS (112u << 23)       // float exponent bias 127 - half exponent bias 15
+#define HALF_DENORM_MAGIC 6.103515625e-05f // 2^-14, the smallest normal half
+#define SRGB_LUT_BITS 12
+#define SRGB_LUT_SIZE (1 << SRGB_LUT_BITS)
+
+typedef void (*ConvertRow_t)(const uint8_t *src, uint32_t width, uint8_t *dst);
+
+uint32_t GetPixelBytes(MagPixelFormat format)
+{
+	switch (format) {
+	case MAG_PIXEL_BGRA8:
+	case MAG_PIXEL_BGRX8:
+	case MAG_PIXEL_RGB10A2:
+		return 4;
+
+	case MAG_PIXEL_RGBA16F:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+static void ConvertRowBGRX8_C(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		uint32_t px;
+		memcpy(&px, src + size_t(x) * 4, 4);
+		px |= 0xFF000000;
+		memcpy(dst + size_t(x) * 4, &px, 4);
+	}
+}
+
+// round(value * 255 / 1023) for every 10 bit value
+static inline uint32_t Scale10To8(uint32_t value)
+{
+	return (value * 1021 + 2048) >> 12;
+}
+
+static void ConvertRowRGB10A2_C(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		uint32_t px;
+		memcpy(&px, src + size_t(x) * 4, 4);
+
+		uint32_t b = Scale10To8(px & 0x3FF);
+		uint32_t g = Scale10To8((px >> 10) & 0x3FF);
+		uint32_t r = Scale10To8((px >> 20) & 0x3FF);
+		uint32_t a = (px >> 30) * 85;
+		px = b | (g << 8) | (r << 16) | (a << 24);
+		memcpy(dst + size_t(x) * 4, &px, 4);
+	}
+}
+
+// Exact for every half, denormals are renormalized by a subtraction
+static inline float HalfToFloat(uint16_t half)
+{
+	uint32_t em = half & 0x7FFF;
+	uint32_t bits = (em << 13) + HALF_EXP_REBIAS;
+	float value;
+
+	if (em >= 0x7C00) {
+		bits += HALF_EXP_REBIAS; // inf or nan
+		memcpy(&value, &bits, 4);
+	} else if (em < 0x400) {
+		bits += 1 << 23;
+		memcpy(&value, &bits, 4);
+		value -= HALF_DENORM_MAGIC;
+	} else {
+		memcpy(&value, &bits, 4);
+	}
+
+	return (half & 0x8000) ? -value : value;
+}
+
+// nan ends up as 0
+static inline int32_t ToneMapIndex(float x)
+{
+	x = (x > 0.0f) ? x : 0.0f;
+	x = (x < HDR_MAX) ? x : HDR_MAX;
+
+	float y = x;
+	if (x > HDR_KNEE) {
+		float t = (x - HDR_KNEE) * HDR_INV_RANGE;
+		y = HDR_KNEE + HDR_RANGE * (t / (1.0f + t));
+	}
+
+	y = (y < 1.0f) ? y : 1.0f;
+	return (int32_t)(y * float(SRGB_LUT_SIZE - 1) + 0.5f);
+}
+
+static inline int32_t AlphaValue(float x)
+{
+	x = (x > 0.0f) ? x : 0.0f;
+	x = (x < 1.0f) ? x : 1.0f;
+	return (int32_t)(x * 255.0f + 0.5f);
+}
+
+// Every half maps to one output byte, so the whole conversion is a table built once from the
+// float math above. Faster than evaluating the curve in SIMD (the division dominates) and the
+// same on every CPU.
+struct ST_HalfTable {
+	uint8_t color[65536]; // tone mapped and sRGB encoded
+	uint8_t alpha[65536];
+
+	ST_HalfTable()
+	{
+		uint8_t srgb[SRGB_LUT_SIZE];
+		for (int i = 0; i < SRGB_LUT_SIZE; i++) {
+			double y = double(i) / (SRGB_LUT_SIZE - 1);
+			double s = (y <= 0.0031308) ? y * 12.92 : 1.055 * pow(y, 1.0 / 2.4) - 0.055;
+			srgb[i] = (uint8_t)floor(s * 255.0 + 0.5);
+		}
+
+		for (uint32_t half = 0; half < 65536; half++) {
+			float value = HalfToFloat((uint16_t)half);
+			color[half] = srgb[ToneMapIndex(value)];
+			alpha[half] = (uint8_t)AlphaValue(value);
+		}
+	}
+};
+
+static void ConvertRowRGBA16F(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	static const ST_HalfTable table;
+
+	for (uint32_t x = 0; x < width; x++) {
+		uint16_t half[4];
+		memcpy(half, src + size_t(x) * 8, 8);
+
+		uint8_t *out = dst + size_t(x) * 4;
+		out[0] = table.color[half[2]];
+		out[1] = table.color[half[1]];
+		out[2] = table.color[half[0]];
+		out[3] = table.alpha[half[3]];
+	}
+}
+
+#ifdef MAG_PIXEL_SSE2
+static void ConvertRowBGRX8_SSE2(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + size_t(x) * 4));
+		_mm_storeu_si128((__m128i *)(dst + size_t(x) * 4), _mm_or_si128(px, alpha));
+	}
+
+	ConvertRowBGRX8_C(src + size_t(x) * 4, width - x, dst + size_t(x) * 4);
+}
+
+// (value, 1) pairs through pmaddwd with (1021, 2048) give value * 1021 + 2048 without a 32 bit multiply
+static inline __m128i Scale10To8_SSE2(__m128i value)
+{
+	const __m128i one = _mm_set1_epi32(0x10000);
+	const __m128i coefs = _mm_set1_epi32((2048 << 16) | 1021);
+	return _mm_srli_epi32(_mm_madd_epi16(_mm_or_si128(value, one), coefs), 12);
+}
+
+static void ConvertRowRGB10A2_SSE2(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	const __m128i mask = _mm_set1_epi32(0x3FF);
+	const __m128i alphaScale = _mm_set1_epi32(85);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + size_t(x) * 4));
+		__m128i b = Scale10To8_SSE2(_mm_and_si128(px, mask));
+		__m128i g = Scale10To8_SSE2(_mm_and_si128(_mm_srli_epi32(px, 10), mask));
+		__m128i r = Scale10To8_SSE2(_mm_and_si128(_mm_srli_epi32(px, 20), mask));
+		__m128i a = _mm_mullo_epi16(_mm_srli_epi32(px, 30), alphaScale);
+
+		__m128i out = _mm_or_si128(_mm_or_si128(b, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(a, 24)));
+		_mm_storeu_si128((__m128i *)(dst + size_t(x) * 4), out);
+	}
+
+	ConvertRowRGB10A2_C(src + size_t(x) * 4, width - x, dst + size_t(x) * 4);
+}
+#endif
+
+#ifdef MAG_ARCH_X86
+MAG_TARGET_AVX2 static void ConvertRowBGRX8_AVX2(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(src + size_t(x) * 4));
+		_mm256_storeu_si256((__m256i *)(dst + size_t(x) * 4), _mm256_or_si256(px, alpha));
+	}
+
+	ConvertRowBGRX8_SSE2(src + size_t(x) * 4, width - x, dst + size_t(x) * 4);
+}
+
+MAG_TARGET_AVX2 static inline __m256i Scale10To8_AVX2(__m256i value)
+{
+	const __m256i one = _mm256_set1_epi32(0x10000);
+	const __m256i coefs = _mm256_set1_epi32((2048 << 16) | 1021);
+	return _mm256_srli_epi32(_mm256_madd_epi16(_mm256_or_si256(value, one), coefs), 12);
+}
+
+MAG_TARGET_AVX2 static void ConvertRowRGB10A2_AVX2(const uint8_t *src, uint32_t width, uint8_t *dst)
+{
+	const __m256i mask = _mm256_set1_epi32(0x3FF);
+	const __m256i alphaScale = _mm256_set1_epi32(85);
+	uint32_t x = 0;
+
+	for (; x + 8 <= width; x += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(src + size_t(x) * 4));
+		__m256i b = Scale10To8_AVX2(_mm256_and_si256(px, mask));
+		__m256i g = Scale10To8_AVX2(_mm256_and_si256(_mm256_srli_epi32(px, 10), mask));
+		__m256i r = Scale10To8_AVX2(_mm256_and_si256(_mm256_srli_epi32(px, 20), mask));
+		__m256i a = _mm256_mullo_epi16(_mm256_srli_epi32(px, 30), alphaScale);
+
+		__m256i out = _mm256_or_si256(_mm256_or_si256(b, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(r, 16), _mm256_slli_epi32(a, 24)));
+		_mm256_storeu_si256((__m256i *)(dst + size_t(x) * 4), out);
+	}
+
+	ConvertRowRGB10A2_SSE2(src + size_t(x) * 4, width - x, dst + size_t(x) * 4);
+}
+#endif
+
+static Kernel<ConvertRow_t> s_ConvertRowBGRX8("ConvertRowBGRX8", {
+	{MAG_CPU_SCALAR, ConvertRowBGRX8_C},
+#ifdef MAG_PIXEL_SSE2
+	{MAG_CPU_SSE2, ConvertRowBGRX8_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, ConvertRowBGRX8_AVX2},
+#endif
+});
+
+static Kernel<ConvertRow_t> s_ConvertRowRGB10A2("ConvertRowRGB10A2", {
+	{MAG_CPU_SCALAR, ConvertRowRGB10A2_C},
+#ifdef MAG_PIXEL_SSE2
+	{MAG_CPU_SSE2, ConvertRowRGB10A2_SSE2},
+#endif
+#ifdef MAG_ARCH_X86
+	{MAG_CPU_AVX2, ConvertRowRGB10A2_AVX2},
+#endif
+});
+
+void ConvertToBGRA(MagPixelFormat format, const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch, uint32_t width, uint32_t rows)
+{
+	ConvertRow_t convert;
+	switch (format) {
+	case MAG_PIXEL_BGRA8:
+		CopyPlane(dst, dstPitch, src, srcPitch, width * 4, rows);
+		return;
+
+	case MAG_PIXEL_BGRX8:
+		convert = s_ConvertRowBGRX8.Get();
+		break;
+
+	case MAG_PIXEL_RGB10A2:
+		convert = s_ConvertRowRGB10A2.Get();
+		break;
+
+	case MAG_PIXEL_RGBA16F:
+		convert = ConvertRowRGBA16F;
+		break;
+
+	default:
+		return;
+	}
+
+	for (uint32_t y = 0; y < rows; y++)
+		convert(src + size_t(srcPitch) * y, width, dst + size_t(dstPitch) * y);
+}
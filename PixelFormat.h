@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+后台缓冲区像素格式 -> 32 位 BGRA 转换
+X8R8G8B8 补齐 alpha，A2R10G10B10 按比例缩放到 8 位，
+A16B16G16R16F (scRGB 线性) 先做色调映射 (0.8 以上平滑压缩到 1.0)，再按 sRGB 编码到 8 位，
+每个 half 值对应一个输出字节，所以首次使用时生成 64K 查找表，之后每个分量只查一次表。
+标量与 SSE2、AVX2 版本的结果逐位一致。
+*/
+
+enum MagPixelFormat {
+	MAG_PIXEL_UNKNOWN = 0,
+	MAG_PIXEL_BGRA8,   // D3DFMT_A8R8G8B8, the output format of the library
+	MAG_PIXEL_BGRX8,   // D3DFMT_X8R8G8B8
+	MAG_PIXEL_RGB10A2, // D3DFMT_A2R10G10B10, B in the low bits
+	MAG_PIXEL_RGBA16F, // D3DFMT_A16B16G16R16F, R in the low half
+};
+
+uint32_t GetPixelBytes(MagPixelFormat format);
+
+// Converts rows of width pixels into BGRA, MAG_PIXEL_BGRA8 is a plain copy
+void ConvertToBGRA(MagPixelFormat format, const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch, uint32_t width, uint32_t rows);
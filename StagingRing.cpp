@@ -0,0 +1,127 @@
+#include "StagingRing.h"
+#include <assert.h>
+
+bool StagingRing::Init(IStagingDevice *device, uint32_t latency)
+{
+	assert(device && !m_pDevice);
+	if (!device)
+		return false;
+
+	if (latency > MAG_MAX_READBACK_LATENCY)
+		latency = MAG_MAX_READBACK_LATENCY;
+
+	if (!device->CreateSlots(latency + 1)) {
+		device->ReleaseSlots();
+		return false;
+	}
+
+	m_pDevice = device;
+	m_uSlots = latency + 1;
+	m_uHead = 0;
+	m_uPending = 0;
+	m_nLocked = -1;
+	m_uLatency = latency;
+	return true;
+}
+
+void StagingRing::Uninit()
+{
+	if (!m_pDevice)
+		return;
+
+	Reset();
+	m_pDevice->ReleaseSlots();
+	m_pDevice = nullptr;
+	m_uSlots = 0;
+}
+
+void StagingRing::Reset()
+{
+	if (m_nLocked >= 0)
+		Unlock((uint32_t)m_nLocked);
+
+	m_nDropped += m_uPending;
+	m_uHead = 0;
+	m_uPending = 0;
+}
+
+bool StagingRing::Push(uint32_t &slot)
+{
+	assert(m_pDevice && m_nLocked < 0);
+	if (!m_pDevice)
+		return false;
+
+	if (m_uPending == m_uSlots) {
+		// nobody popped since the last push
+		m_uHead = (m_uHead + 1) % m_uSlots;
+		m_uPending--;
+		++m_nDropped;
+	}
+
+	uint32_t next = (m_uHead + m_uPending) % m_uSlots;
+	if (!m_pDevice->Copy(next))
+		return false;
+
+	m_uPending++;
+	++m_nCopies;
+	slot = next;
+	return true;
+}
+
+bool StagingRing::Pop(uint32_t &slot, ST_StagingLock &lock)
+{
+	assert(m_pDevice && m_nLocked < 0);
+	if (!m_pDevice || !HasDue())
+		return false;
+
+	return LockHead(slot, lock);
+}
+
+bool StagingRing::PopLatest(uint32_t &slot, ST_StagingLock &lock)
+{
+	assert(m_pDevice && m_nLocked < 0);
+	if (!m_pDevice || !m_uPending)
+		return false;
+
+	m_uHead = (m_uHead + m_uPending - 1) % m_uSlots;
+	m_nDropped += m_uPending - 1;
+	m_uPending = 1;
+	return LockHead(slot, lock);
+}
+
+bool StagingRing::LockHead(uint32_t &slot, ST_StagingLock &lock)
+{
+	slot = m_uHead;
+	m_uHead = (m_uHead + 1) % m_uSlots;
+	m_uPending--;
+
+	if (!m_pDevice->IsReady(slot))
+		++m_nStalls;
+
+	if (!m_pDevice->Lock(slot, lock)) {
+		++m_nDropped;
+		return false;
+	}
+
+	m_nLocked = (int32_t)slot;
+	++m_nReads;
+	return true;
+}
+
+void StagingRing::Unlock(uint32_t slot)
+{
+	assert(m_nLocked == (int32_t)slot);
+	m_pDevice->Unlock(slot);
+	m_nLocked = -1;
+}
+
+ST_StagingStats StagingRing::GetStats() const
+{
+	ST_StagingStats ret;
+	ret.latency = m_uLatency;
+	ret.copies = m_nCopies;
+	ret.reads = m_nReads;
+	ret.stalls = m_nStalls;
+	ret.dropped = m_nDropped;
+	return ret;
+}
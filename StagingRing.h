@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/*
+回读用的暂存表面环 (平台无关，GPU 操作通过 IStagingDevice 完成，测试时可以换成模拟设备)
+每次 Present 把后台缓冲区异步复制到环中的下一个表面，再读取 latency 次 Present 之前复制的表面，
+那时复制早已完成，Present 线程不必等待 GPU。代价是输出的帧晚 latency 次 Present。
+latency 为 0 时每帧复制后立刻读取，与只有一个表面相同。
+Reset 丢弃尚未读取的复制 (设备丢失、尺寸或延迟改变)，PopLatest 丢弃较旧的复制、立即读取最新的一个 (按需采集跳过若干次 Present 之后)。只在一个线程 (magnifier 线程) 使用，统计数据可以在任意线程读取。
+*/
+
+#define MAG_MAX_READBACK_LATENCY 3
+
+struct ST_StagingLock {
+	const uint8_t *bits = nullptr;
+	int32_t pitch = 0;
+};
+
+struct ST_StagingStats {
+	uint32_t latency = 0; // in presents
+	uint64_t copies = 0;  // frames copied into a staging surface
+	uint64_t reads = 0;   // staging surfaces locked and handed on
+	uint64_t stalls = 0;  // reads whose copy had not finished yet, Lock waited for the GPU
+	uint64_t dropped = 0; // copies discarded before they were read
+};
+
+// The GPU side of StagingRing, slots are numbered 0 .. count - 1
+class IStagingDevice {
+public:
+	virtual ~IStagingDevice() = default;
+
+	// count staging surfaces of the current back buffer size and format
+	virtual bool CreateSlots(uint32_t count) = 0;
+	virtual void ReleaseSlots() = 0;
+
+	// Queues a copy of the current back buffer into slot, should not wait for the GPU
+	virtual bool Copy(uint32_t slot) = 0;
+	// The copy into slot finished, Lock will not wait
+	virtual bool IsReady(uint32_t slot) = 0;
+	// Whole surface, waits for the copy if it is still running
+	virtual bool Lock(uint32_t slot, ST_StagingLock &lock) = 0;
+	virtual void Unlock(uint32_t slot) = 0;
+};
+
+class StagingRing {
+public:
+	StagingRing() = default;
+	StagingRing(const StagingRing &) = delete;
+	StagingRing &operator=(const StagingRing &) = delete;
+	~StagingRing() { Uninit(); }
+
+	// latency is clamped to MAG_MAX_READBACK_LATENCY, the ring holds latency + 1 surfaces
+	bool Init(IStagingDevice *device, uint32_t latency);
+	void Uninit();
+	bool IsInited() const { return m_pDevice != nullptr; }
+	void Reset();
+
+	// Copies the current frame into the next slot and returns it, the caller keeps its metadata by slot.
+	// A full ring drops its oldest copy
+	bool Push(uint32_t &slot);
+	// The oldest copy once more than latency copies are pending, false while the ring fills up.
+	// The slot leaves the ring even if Lock fails, Unlock it before the next Push
+	bool Pop(uint32_t &slot, ST_StagingLock &lock);
+	// The newest copy as soon as anything is pending, the older ones are dropped. Lock waits for the GPU if the copy is still running
+	bool PopLatest(uint32_t &slot, ST_StagingLock &lock);
+	void Unlock(uint32_t slot);
+
+	uint32_t GetPending() const { return m_uPending; }
+	// Pop has a copy to read
+	bool HasDue() const { return m_uSlots && m_uPending >= m_uSlots; }
+	ST_StagingStats GetStats() const;
+
+private:
+	bool LockHead(uint32_t &slot, ST_StagingLock &lock);
+
+	IStagingDevice *m_pDevice = nullptr; /* not owned */
+	uint32_t m_uSlots = 0;
+	uint32_t m_uHead = 0; // oldest pending copy
+	uint32_t m_uPending = 0;
+	int32_t m_nLocked = -1;
+
+	std::atomic<uint32_t> m_uLatency = {0};
+	std::atomic<uint64_t> m_nCopies = {0};
+	std::atomic<uint64_t> m_nReads = {0};
+	std::atomic<uint64_t> m_nStalls = {0};
+	std::atomic<uint64_t> m_nDropped = {0};
+};
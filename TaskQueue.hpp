@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+magnifier 线程的任务队列，投递任务不分配内存
+InlineTask 把 lambda (包括捕获的 shared_ptr、vector 等) 直接存放在对象内部的固定缓冲区里，捕获放不下时编译失败。
+MpscQueue 是有界的无锁多生产者/单消费者环形队列 (每个槽位带序号)，生产者之间只竞争一次 CAS，消费者不需要任何原子读改写。
+队列满时 Push 返回 false，由调用者决定等待还是丢弃。
+*/
+
+class InlineTask {
+public:
+	static const size_t INLINE_SIZE = 64; // a shared_ptr and a few settings
+
+	InlineTask() = default;
+	InlineTask(const InlineTask &) = delete;
+	InlineTask &operator=(const InlineTask &) = delete;
+
+	template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineTask>::value>::type> InlineTask(F &&func)
+	{
+		typedef typename std::decay<F>::type Func_t;
+		static_assert(sizeof(Func_t) <= INLINE_SIZE, "the captures do not fit into InlineTask");
+		static_assert(alignof(Func_t) <= alignof(std::max_align_t), "over-aligned captures");
+
+		new (m_Storage) Func_t(std::forward<F>(func));
+		m_pManage = &Manage<Func_t>;
+	}
+
+	InlineTask(InlineTask &&other) { MoveFrom(other); }
+
+	InlineTask &operator=(InlineTask &&other)
+	{
+		if (this != &other) {
+			Clear();
+			MoveFrom(other);
+		}
+		return *this;
+	}
+
+	~InlineTask() { Clear(); }
+
+	void operator()() { m_pManage(TASK_INVOKE, m_Storage, nullptr); }
+	explicit operator bool() const { return m_pManage != nullptr; }
+
+	// Destroys the callable and its captures
+	void Clear()
+	{
+		if (m_pManage) {
+			m_pManage(TASK_DESTROY, m_Storage, nullptr);
+			m_pManage = nullptr;
+		}
+	}
+
+private:
+	enum TaskOp {
+		TASK_INVOKE = 0,
+		TASK_MOVE, // storage is constructed from other, other is destroyed
+		TASK_DESTROY,
+	};
+
+	typedef void (*Manage_t)(TaskOp op, void *storage, void *other);
+
+	template <typename Func_t> static void Manage(TaskOp op, void *storage, void *other)
+	{
+		Func_t *func = static_cast<Func_t *>(storage);
+		switch (op) {
+		case TASK_INVOKE:
+			(*func)();
+			break;
+
+		case TASK_MOVE:
+			new (storage) Func_t(std::move(*static_cast<Func_t *>(other)));
+			static_cast<Func_t *>(other)->~Func_t();
+			break;
+
+		case TASK_DESTROY:
+			func->~Func_t();
+			break;
+		}
+	}
+
+	void MoveFrom(InlineTask &other)
+	{
+		m_pManage = other.m_pManage;
+		if (m_pManage) {
+			m_pManage(TASK_MOVE, m_Storage, other.m_Storage);
+			other.m_pManage = nullptr;
+		}
+	}
+
+	alignas(std::max_align_t) unsigned char m_Storage[INLINE_SIZE];
+	Manage_t m_pManage = nullptr;
+};
+
+// N is a power of 2
+template <class T, size_t N> class MpscQueue {
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscQueue size must be a power of 2");
+
+public:
+	MpscQueue()
+	{
+		for (size_t i = 0; i < N; i++)
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	// Any thread. value is moved into the queue, it is left untouched if the queue is full.
+	bool Push(T &value)
+	{
+		size_t pos = m_tail.load(std::memory_order_relaxed);
+		ST_Cell *cell;
+		for (;;) {
+			cell = &m_cells[pos & (N - 1)];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false; // the consumer has not taken the value N pushes ago
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->value = std::move(value);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only. Stops at a cell whose producer has not finished writing yet.
+	bool Pop(T &out)
+	{
+		ST_Cell &cell = m_cells[m_head & (N - 1)];
+		if (cell.seq.load(std::memory_order_acquire) != m_head + 1)
+			return false;
+
+		out = std::move(cell.value);
+		cell.seq.store(m_head + N, std::memory_order_release);
+		m_head++;
+		return true;
+	}
+
+private:
+	struct ST_Cell {
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	std::atomic<size_t> m_tail = {0}; // producers
+	uint8_t m_padding[64 - sizeof(std::atomic<size_t>)];
+	size_t m_head = 0; // owned by consumer
+	ST_Cell m_cells[N];
+};
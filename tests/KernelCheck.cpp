@@ -0,0 +1,392 @@
+#include "KernelCheck.h"
+#include "FrameCopy.h"
+#include "FrameHash.h"
+#include "ColorConvert.h"
+#include "FrameScale.h"
+#include "PixelFormat.h"
+#include <string.h>
+#include <chrono>
+
+#define CHECK_GUARD 0xCD      // fill byte around and inside output buffers, compared like the output
+#define CHECK_MAX_OFFSET 64   // buffers start at a random offset below this, so nothing is aligned
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_MIN_SECONDS 0.05 // per function and level
+
+// xorshift64*, the same seed gives the same case on every level
+class CheckRandom {
+public:
+	explicit CheckRandom(uint64_t seed) : m_uState(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+	uint32_t Next()
+	{
+		m_uState ^= m_uState >> 12;
+		m_uState ^= m_uState << 25;
+		m_uState ^= m_uState >> 27;
+		return (uint32_t)((m_uState * 0x2545F4914F6CDD1DULL) >> 32);
+	}
+
+	uint32_t Range(uint32_t lo, uint32_t hi) { return lo + Next() % (hi - lo + 1); }
+
+	void Fill(uint8_t *data, size_t bytes)
+	{
+		for (size_t i = 0; i < bytes; i++)
+			data[i] = (uint8_t)Next();
+	}
+
+private:
+	uint64_t m_uState;
+};
+
+struct ST_CheckBuffer {
+	std::vector<uint8_t> storage;
+	uint8_t *data = nullptr;
+
+	void Init(CheckRandom &rng, size_t bytes, bool bRandom)
+	{
+		storage.assign(bytes + 2 * CHECK_MAX_OFFSET, CHECK_GUARD);
+		data = storage.data() + rng.Next() % CHECK_MAX_OFFSET;
+		if (bRandom)
+			rng.Fill(data, bytes);
+	}
+};
+
+static void AppendOutput(std::vector<uint8_t> &out, const ST_CheckBuffer &buffer)
+{
+	out.insert(out.end(), buffer.storage.begin(), buffer.storage.end());
+}
+
+static void AppendOutput(std::vector<uint8_t> &out, uint64_t value)
+{
+	const uint8_t *bytes = (const uint8_t *)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+// Mostly small odd sizes, sometimes a single pixel or a row longer than any SIMD loop unrolls
+static void RandomSize(CheckRandom &rng, uint32_t &width, uint32_t &height)
+{
+	switch (rng.Next() % 8) {
+	case 0:
+		width = rng.Range(1, 4);
+		height = rng.Range(1, 4);
+		break;
+
+	case 1:
+		width = rng.Range(1024, 4096);
+		height = rng.Range(1, 4);
+		break;
+
+	default:
+		width = rng.Range(1, 160);
+		height = rng.Range(1, 40);
+		break;
+	}
+}
+
+// Tight or padded by any number of bytes
+static int32_t RandomPitch(CheckRandom &rng, size_t rowBytes)
+{
+	return (int32_t)(rowBytes + ((rng.Next() % 3) ? rng.Range(0, 80) : 0));
+}
+
+typedef void (*PlaneCopy_t)(uint8_t *, int32_t, const uint8_t *, int32_t, uint32_t, uint32_t);
+
+static void CheckPlaneCopy(CheckRandom &rng, std::vector<uint8_t> &out, PlaneCopy_t copy)
+{
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	uint32_t rowBytes = width * 4 - rng.Range(0, 3);
+	int32_t srcPitch = RandomPitch(rng, rowBytes);
+	int32_t dstPitch = (rng.Next() % 2) ? srcPitch : RandomPitch(rng, rowBytes);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * height, true);
+	dst.Init(rng, size_t(dstPitch) * height, false);
+
+	copy(dst.data, dstPitch, src.data, srcPitch, rowBytes, height);
+	AppendOutput(out, dst);
+}
+
+static void CheckCopyPlane(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	CheckPlaneCopy(rng, out, CopyPlane);
+}
+
+static void CheckStreamPlane(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	CheckPlaneCopy(rng, out, StreamPlane);
+}
+
+static void CheckHashPlane(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	uint32_t rowBytes = width * 4 - rng.Range(0, 3);
+	int32_t pitch = RandomPitch(rng, rowBytes);
+
+	ST_CheckBuffer src;
+	src.Init(rng, size_t(pitch) * height, true);
+	AppendOutput(out, HashPlane(src.data, pitch, rowBytes, height));
+}
+
+static void CheckCopyHashPlane(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	uint32_t rowBytes = width * 4 - rng.Range(0, 3);
+	int32_t srcPitch = RandomPitch(rng, rowBytes);
+	int32_t dstPitch = RandomPitch(rng, rowBytes);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * height, true);
+	dst.Init(rng, size_t(dstPitch) * height, false);
+
+	AppendOutput(out, CopyHashPlane(dst.data, dstPitch, src.data, srcPitch, rowBytes, height));
+	AppendOutput(out, dst);
+}
+
+static void CheckConvertYuv(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	int32_t srcPitch = RandomPitch(rng, size_t(width) * 4);
+	MagYuvFormat format = (rng.Next() % 2) ? MAG_YUV_NV12 : MAG_YUV_I420;
+
+	ST_YuvCoefs coefs;
+	CalcYuvCoefs((MagColorMatrix)(rng.Next() % 2), (MagColorRange)(rng.Next() % 2), coefs);
+
+	size_t offsets[3];
+	int32_t pitches[3];
+	size_t size = CalcYuvLayout(format, width, height, offsets, pitches);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * height, true);
+	dst.Init(rng, size, false);
+
+	uint8_t *planes[3];
+	for (int i = 0; i < 3; i++)
+		planes[i] = pitches[i] ? dst.data + offsets[i] : nullptr;
+
+	// two bands split at a random even row, the same as one call
+	uint32_t split = rng.Range(0, height) & ~1u;
+	ConvertBGRAToYuv(src.data, srcPitch, width, height, 0, split, format, planes, pitches, coefs);
+	ConvertBGRAToYuv(src.data, srcPitch, width, height, split, height, format, planes, pitches, coefs);
+	AppendOutput(out, dst);
+}
+
+static void CheckScale32(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	uint32_t srcWidth, srcHeight;
+	RandomSize(rng, srcWidth, srcHeight);
+	uint32_t dstWidth = rng.Range(1, srcWidth * 2);
+	uint32_t dstHeight = rng.Range(1, srcHeight * 2);
+	int32_t srcPitch = RandomPitch(rng, size_t(srcWidth) * 4);
+	int32_t dstPitch = RandomPitch(rng, size_t(dstWidth) * 4);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * srcHeight, true);
+	dst.Init(rng, size_t(dstPitch) * dstHeight, false);
+
+	FrameScaler scaler;
+	scaler.Prepare((MagScaleFilter)(rng.Next() % 3), srcWidth, srcHeight, dstWidth, dstHeight);
+	scaler.Scale32(src.data, srcPitch, dst.data, dstPitch);
+	AppendOutput(out, dst);
+}
+
+static void CheckDownsample2x(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	uint32_t dstWidth = (width > 1) ? width / 2 : 1;
+	uint32_t dstHeight = (height > 1) ? height / 2 : 1;
+	int32_t srcPitch = RandomPitch(rng, size_t(width) * 4);
+	int32_t dstPitch = RandomPitch(rng, size_t(dstWidth) * 4);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * height, true);
+	dst.Init(rng, size_t(dstPitch) * dstHeight, false);
+
+	Downsample2x32(src.data, srcPitch, width, height, dst.data, dstPitch);
+	AppendOutput(out, dst);
+}
+
+static void CheckConvertToBGRA(CheckRandom &rng, std::vector<uint8_t> &out)
+{
+	static const MagPixelFormat formats[] = {MAG_PIXEL_BGRX8, MAG_PIXEL_RGB10A2, MAG_PIXEL_RGBA16F};
+	MagPixelFormat format = formats[rng.Next() % 3];
+
+	uint32_t width, height;
+	RandomSize(rng, width, height);
+	int32_t srcPitch = RandomPitch(rng, size_t(width) * GetPixelBytes(format));
+	int32_t dstPitch = RandomPitch(rng, size_t(width) * 4);
+
+	ST_CheckBuffer src, dst;
+	src.Init(rng, size_t(srcPitch) * height, true);
+	dst.Init(rng, size_t(dstPitch) * height, false);
+
+	ConvertToBGRA(format, src.data, srcPitch, dst.data, dstPitch, width, height);
+	AppendOutput(out, dst);
+}
+
+// Source and destination of the throughput runs, a 1080p BGRA frame and room for any output
+struct ST_BenchFrame {
+	std::vector<uint8_t> src;
+	std::vector<uint8_t> dst;
+	FrameScaler scaler;
+	ST_YuvCoefs coefs;
+	size_t offsets[3];
+	int32_t pitches[3];
+};
+
+static size_t BenchCopyPlane(ST_BenchFrame &frame)
+{
+	CopyPlane(frame.dst.data(), BENCH_WIDTH * 4, frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH * 4, BENCH_HEIGHT);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchStreamPlane(ST_BenchFrame &frame)
+{
+	StreamPlane(frame.dst.data(), BENCH_WIDTH * 4, frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH * 4, BENCH_HEIGHT);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchHashPlane(ST_BenchFrame &frame)
+{
+	volatile uint64_t hash = HashPlane(frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH * 4, BENCH_HEIGHT);
+	(void)hash;
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchCopyHashPlane(ST_BenchFrame &frame)
+{
+	volatile uint64_t hash = CopyHashPlane(frame.dst.data(), BENCH_WIDTH * 4, frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH * 4, BENCH_HEIGHT);
+	(void)hash;
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchConvertYuv(ST_BenchFrame &frame)
+{
+	uint8_t *planes[3] = {frame.dst.data() + frame.offsets[0], frame.dst.data() + frame.offsets[1], nullptr};
+	ConvertBGRAToYuv(frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH, BENCH_HEIGHT, 0, BENCH_HEIGHT, MAG_YUV_NV12, planes, frame.pitches, frame.coefs);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchScale32(ST_BenchFrame &frame)
+{
+	frame.scaler.Scale32(frame.src.data(), BENCH_WIDTH * 4, frame.dst.data(), frame.scaler.GetDstWidth() * 4);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchDownsample2x(ST_BenchFrame &frame)
+{
+	Downsample2x32(frame.src.data(), BENCH_WIDTH * 4, BENCH_WIDTH, BENCH_HEIGHT, frame.dst.data(), BENCH_WIDTH * 2);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+static size_t BenchConvertToBGRA(ST_BenchFrame &frame)
+{
+	ConvertToBGRA(MAG_PIXEL_RGB10A2, frame.src.data(), BENCH_WIDTH * 4, frame.dst.data(), BENCH_WIDTH * 4, BENCH_WIDTH, BENCH_HEIGHT);
+	return size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT;
+}
+
+typedef void (*CheckCase_t)(CheckRandom &rng, std::vector<uint8_t> &out);
+typedef size_t (*BenchCase_t)(ST_BenchFrame &frame);
+
+struct ST_CheckEntry {
+	const char *name;
+	CheckCase_t check;
+	BenchCase_t bench;
+};
+
+static const ST_CheckEntry s_entries[] = {
+	{"CopyPlane", CheckCopyPlane, BenchCopyPlane},
+	{"StreamPlane", CheckStreamPlane, BenchStreamPlane},
+	{"HashPlane", CheckHashPlane, BenchHashPlane},
+	{"CopyHashPlane", CheckCopyHashPlane, BenchCopyHashPlane},
+	{"ConvertBGRAToYuv", CheckConvertYuv, BenchConvertYuv},
+	{"FrameScaler::Scale32", CheckScale32, BenchScale32},
+	{"Downsample2x32", CheckDownsample2x, BenchDownsample2x},
+	{"ConvertToBGRA", CheckConvertToBGRA, BenchConvertToBGRA},
+};
+
+static double MeasureGBps(BenchCase_t bench, ST_BenchFrame &frame)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	bench(frame); // warm up caches and lazily built tables
+	size_t bytes = 0;
+	Clock::time_point start = Clock::now();
+	double seconds = 0;
+	do {
+		bytes += bench(frame);
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (seconds < BENCH_MIN_SECONDS);
+
+	return double(bytes) / seconds / 1e9;
+}
+
+bool CheckKernels(uint32_t cases, uint32_t seed, bool bMeasure, std::vector<ST_KernelCheckResult> *results)
+{
+	MagCpuLevel savedLimit = GetKernelLevelLimit();
+	MagCpuLevel supported = GetSupportedCpuLevel();
+	size_t entryCount = sizeof(s_entries) / sizeof(s_entries[0]);
+	std::vector<ST_KernelCheckResult> local(entryCount * (supported + 1));
+
+	for (size_t e = 0; e < entryCount; e++) {
+		for (int level = MAG_CPU_SCALAR; level <= supported; level++) {
+			ST_KernelCheckResult &result = local[e * (supported + 1) + level];
+			result.name = s_entries[e].name;
+			result.level = (MagCpuLevel)level;
+			result.cases = cases;
+		}
+	}
+
+	std::vector<uint8_t> reference, output;
+	for (uint32_t i = 0; i < cases; i++) {
+		for (size_t e = 0; e < entryCount; e++) {
+			uint64_t caseSeed = (uint64_t(seed) << 32) | (i * entryCount + e);
+
+			SelectKernels(MAG_CPU_SCALAR);
+			CheckRandom refRng(caseSeed);
+			reference.clear();
+			s_entries[e].check(refRng, reference);
+
+			for (int level = MAG_CPU_SSE2; level <= supported; level++) {
+				SelectKernels((MagCpuLevel)level);
+				CheckRandom rng(caseSeed);
+				output.clear();
+				s_entries[e].check(rng, output);
+
+				if (output != reference)
+					local[e * (supported + 1) + level].mismatches++;
+			}
+		}
+	}
+
+	if (bMeasure) {
+		ST_BenchFrame frame;
+		frame.src.resize(size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT);
+		frame.dst.resize(size_t(BENCH_WIDTH) * 4 * BENCH_HEIGHT);
+		CheckRandom(seed).Fill(frame.src.data(), frame.src.size());
+		CalcYuvCoefs(MAG_MATRIX_BT709, MAG_RANGE_LIMITED, frame.coefs);
+		CalcYuvLayout(MAG_YUV_NV12, BENCH_WIDTH, BENCH_HEIGHT, frame.offsets, frame.pitches);
+		frame.scaler.Prepare(MAG_SCALE_AREA, BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 2 / 3, BENCH_HEIGHT * 2 / 3);
+
+		for (int level = MAG_CPU_SCALAR; level <= supported; level++) {
+			SelectKernels((MagCpuLevel)level);
+			for (size_t e = 0; e < entryCount; e++)
+				local[e * (supported + 1) + level].gbps = MeasureGBps(s_entries[e].bench, frame);
+		}
+	}
+
+	SelectKernels(savedLimit);
+
+	bool bMatch = true;
+	for (const ST_KernelCheckResult &result : local)
+		bMatch = bMatch && !result.mismatches;
+
+	if (results)
+		results->swap(local);
+
+	return bMatch;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "KernelDispatch.h"
+#include <vector>
+#include <stdint.h>
+
+/*
+SIMD 内核与标量版本的差分校验 (平台无关，Linux 上也可以直接编译运行)
+每个用例随机生成宽高、pitch、起始地址偏移和像素内容 (包括 1 像素宽的小图和 4096 宽的长行)，
+先在标量级别运行得到参考输出，再在 CPU 支持的每个级别上运行并逐字节比较，输出缓冲区的保护区也参与比较。
+所有内核都应该与标量版本逐位一致，没有容差。
+可选地在 1920x1080 的帧上测量每个级别的吞吐量 (按源数据计算的 GB/s)。
+校验期间会切换整个进程的内核，不要在采集进行时调用。
+*/
+
+struct ST_KernelCheckResult {
+	const char *name = nullptr; // public function that was exercised
+	MagCpuLevel level = MAG_CPU_SCALAR;
+	uint32_t cases = 0;
+	uint32_t mismatches = 0;
+	double gbps = 0; // 0 if not measured
+};
+
+// Returns true if every level matched the scalar output in every case
+bool CheckKernels(uint32_t cases, uint32_t seed, bool bMeasure, std::vector<ST_KernelCheckResult> *results = nullptr);
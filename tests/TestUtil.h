@@ -0,0 +1,49 @@
+#pragma once
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+测试与基准程序共用的小工具
+CHECK 失败时打印位置并以非零值退出，随机数固定种子保证失败可以复现。
+*/
+
+#define CHECK(x)                                                                   \
+	do {                                                                       \
+		if (!(x)) {                                                        \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #x);        \
+			exit(1);                                                   \
+		}                                                                  \
+	} while (0)
+
+// xorshift64*, deterministic for a seed
+class TestRandom {
+public:
+	explicit TestRandom(uint64_t seed) : m_nState(seed ? seed : 1) {}
+
+	uint64_t Next()
+	{
+		m_nState ^= m_nState >> 12;
+		m_nState ^= m_nState << 25;
+		m_nState ^= m_nState >> 27;
+		return m_nState * 2685821657736338717ull;
+	}
+
+	// [0, n)
+	uint32_t Below(uint32_t n) { return n ? (uint32_t)(Next() % n) : 0; }
+
+	void Fill(uint8_t *data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+			data[i] = (uint8_t)(Next() >> 56);
+	}
+
+private:
+	uint64_t m_nState;
+};
+
+inline double NowSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
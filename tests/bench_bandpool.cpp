@@ -0,0 +1,70 @@
+#include "BandPool.h"
+#include "FrameCopy.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Banded copy of an 8K frame with 1 .. N threads (the submitting thread plus N - 1 workers).
+// bench_bandpool [max threads [iterations]], the default is the number of hardware threads.
+static double TimeBanded(BandQueue &queue, uint8_t *dst, const uint8_t *src, int32_t pitch, uint32_t height, bool bStream, int iterations)
+{
+	double best = 1e9;
+	for (int i = 0; i < iterations; i++) {
+		double t0 = NowSeconds();
+		queue.Run(height, 1, [&](uint32_t begin, uint32_t end) {
+			if (bStream)
+				StreamPlane(dst + size_t(pitch) * begin, pitch, src + size_t(pitch) * begin, pitch, pitch, end - begin);
+			else
+				CopyPlane(dst + size_t(pitch) * begin, pitch, src + size_t(pitch) * begin, pitch, pitch, end - begin);
+		});
+		double t = NowSeconds() - t0;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	SelectKernels(MAG_CPU_AUTO);
+	uint32_t maxThreads = (argc > 1) ? (uint32_t)atoi(argv[1]) : std::thread::hardware_concurrency();
+	int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+	if (maxThreads < 1)
+		maxThreads = 1;
+	if (maxThreads > MAG_BAND_MAX_THREADS + 1)
+		maxThreads = MAG_BAND_MAX_THREADS + 1;
+
+	const uint32_t width = 7680, height = 4320;
+	const int32_t pitch = width * 4;
+	const size_t bytes = size_t(pitch) * height;
+	std::vector<uint8_t> src(bytes, 1), dst(bytes);
+	memcpy(dst.data(), src.data(), bytes); // fault the pages in
+
+	double single = 1e9;
+	for (int i = 0; i < iterations; i++) {
+		double t0 = NowSeconds();
+		memmove(dst.data(), src.data(), bytes);
+		double t = NowSeconds() - t0;
+		if (t < single)
+			single = t;
+	}
+	printf("8K frame %.0f MB, %u hardware threads\n", bytes / 1048576.0, std::thread::hardware_concurrency());
+	printf("memmove on one thread      %7.2f ms  %5.1f GB/s\n", single * 1e3, bytes / single / 1e9);
+
+	BandPool pool;
+	BandQueue queue(&pool);
+	for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+		pool.SetThreads(threads - 1);
+		for (int stream = 0; stream < 2; stream++) {
+			double t = TimeBanded(queue, dst.data(), src.data(), pitch, height, stream != 0, iterations);
+			printf("%2u threads %-9s       %7.2f ms  %5.1f GB/s  %4.2fx\n", threads, stream ? "streaming" : "temporal", t * 1e3, bytes / t / 1e9, single / t);
+		}
+	}
+
+	ST_BandQueueStats stats = queue.GetStats();
+	printf("jobs %llu, bands %llu, stolen %llu, submitting thread waited %.2f ms in total\n", (unsigned long long)stats.jobs, (unsigned long long)stats.bands, (unsigned long long)stats.stolenBands,
+	       stats.waitMicros / 1e3);
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include "DirtyRects.h"
+#include "FrameCopy.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <vector>
+
+// Incremental update of a persistent 4K frame from a few dirty rects against the full frame copy,
+// plus the cost of building the rect list from a PresentEx region
+int main(int argc, char **argv)
+{
+	SelectKernels(MAG_CPU_AUTO);
+	int iterations = (argc > 1) ? atoi(argv[1]) : 50;
+
+	const int32_t width = 3840, height = 2160, pitch = width * 4;
+	std::vector<uint8_t> surface(size_t(pitch) * height), frame(size_t(pitch) * height);
+	TestRandom rnd(6);
+	rnd.Fill(surface.data(), surface.size());
+	CopyPlane(frame.data(), pitch, surface.data(), pitch, pitch, height);
+
+	double t0 = NowSeconds();
+	for (int i = 0; i < iterations; i++)
+		CopyPlane(frame.data(), pitch, surface.data(), pitch, pitch, height);
+	double full = (NowSeconds() - t0) / iterations;
+	printf("full 4K copy                      %8.3f ms\n", full * 1e3);
+
+	// a caret, a text line, a dialog and a scrolled pane
+	const struct {
+		const char *name;
+		uint32_t rects;
+		int32_t size;
+	} cases[] = {{"1 rect 16x32 (caret)", 1, 32}, {"4 rects 400x40 (typing)", 4, 400}, {"16 rects 256x256", 16, 256}, {"64 rects 128x128 (merged)", 64, 128}, {"1 rect 1920x1080", 1, 1080}};
+
+	for (const auto &c : cases) {
+		std::vector<ST_DirtyRect> region;
+		for (uint32_t i = 0; i < c.rects; i++) {
+			ST_DirtyRect rc;
+			rc.left = (int32_t)rnd.Below(width - c.size);
+			rc.top = (int32_t)rnd.Below(height - c.size);
+			rc.right = rc.left + (c.size == 32 ? 16 : c.size);
+			rc.bottom = rc.top + (c.size == 400 ? 40 : c.size);
+			if (c.size == 1080)
+				rc.right = rc.left + 1920 < width ? rc.left + 1920 : width;
+			region.push_back(rc);
+		}
+
+		ST_DirtyRectList list;
+		t0 = NowSeconds();
+		for (int i = 0; i < iterations * 100; i++) {
+			ClearDirtyRects(list);
+			for (const ST_DirtyRect &rc : region)
+				AddDirtyRect(list, rc, width, height);
+		}
+		double build = (NowSeconds() - t0) / (iterations * 100);
+
+		t0 = NowSeconds();
+		for (int i = 0; i < iterations; i++)
+			CopyDirtyRects32(frame.data(), pitch, surface.data(), pitch, list);
+		double copy = (NowSeconds() - t0) / iterations;
+
+		printf("%-27s build %6.2f us (%2u rects), copy %8.3f ms, %6.1fx faster than full\n", c.name, build * 1e6, list.count, copy * 1e3, full / (copy + build));
+	}
+	return 0;
+}
@@ -0,0 +1,63 @@
+#include "FrameCopy.h"
+#include "FrameAlignment.hpp"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <vector>
+
+// Cropped readback against the old full-surface memmove, on a synthetic 4K surface with a padded pitch
+struct ST_CropCase {
+	const char *name;
+	uint32_t width;
+	uint32_t height;
+};
+
+static double TimeCopy(uint8_t *dst, int32_t dstPitch, const uint8_t *src, int32_t srcPitch, uint32_t rowBytes, uint32_t rows, int iterations)
+{
+	CopyPlane(dst, dstPitch, src, srcPitch, rowBytes, rows);
+	double t0 = NowSeconds();
+	for (int i = 0; i < iterations; i++)
+		CopyPlane(dst, dstPitch, src, srcPitch, rowBytes, rows);
+	return (NowSeconds() - t0) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	SelectKernels(MAG_CPU_AUTO);
+	int iterations = (argc > 1) ? atoi(argv[1]) : 30;
+
+	const uint32_t width = 3840, height = 2160;
+	const int32_t srcPitch = width * 4 + 256; // drivers pad the pitch of the system memory copy
+	std::vector<uint8_t> surface(size_t(srcPitch) * height);
+	TestRandom rnd(1);
+	rnd.Fill(surface.data(), surface.size());
+	std::vector<uint8_t> frame(surface.size() + MAG_PAGE_SIZE);
+
+	double full = 0;
+	{
+		memmove(frame.data(), surface.data(), surface.size()); // fault the pages in
+		double t0 = NowSeconds();
+		for (int i = 0; i < iterations; i++)
+			memmove(frame.data(), surface.data(), surface.size());
+		full = (NowSeconds() - t0) / iterations;
+	}
+	printf("%-28s %8.3f ms  %6.2f GB/s\n", "full surface memmove", full * 1e3, surface.size() / full / 1e9);
+
+	const ST_CropCase cases[] = {
+	    {"full 3840x2160", 3840, 2160}, {"1920x1080 crop", 1920, 1080}, {"1280x720 crop", 1280, 720}, {"640x360 crop", 640, 360}, {"odd 1001x333 crop", 1001, 333},
+	};
+
+	const MagPitchPolicy policies[] = {MAG_PITCH_PACKED, MAG_PITCH_CACHE_LINE, MAG_PITCH_NO_4K_ALIAS};
+	const char *policyNames[] = {"packed", "cache line", "no 4K alias"};
+
+	for (const ST_CropCase &c : cases) {
+		uint32_t rowBytes = c.width * 4;
+		const uint8_t *src = surface.data() + size_t(srcPitch) * ((height - c.height) / 2) + size_t((width - c.width) / 2) * 4;
+		for (int p = 0; p < 3; p++) {
+			int32_t dstPitch = CalcFramePitch(rowBytes, srcPitch, policies[p]);
+			double t = TimeCopy(frame.data(), dstPitch, src, srcPitch, rowBytes, c.height, iterations);
+			printf("%-18s %-11s %8.3f ms  %6.2f GB/s  %5.1fx faster than full\n", c.name, policyNames[p], t * 1e3, double(rowBytes) * c.height / t / 1e9, full / t);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "FrameCopy.h"
+#include "FrameHash.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <vector>
+
+// Duplicate suppression on synthetic content: every present is copied with the hash folded into the copy,
+// a frame whose hash matches the previous one is counted as a repeat instead of being published.
+// Static content publishes once, changing content publishes every frame for the price of the hash.
+struct ST_ContentCase {
+	const char *name;
+	uint32_t changeEvery; // frames between changes, 0 for static
+};
+
+struct ST_RunStats {
+	double seconds = 0;
+	uint64_t published = 0;
+	uint64_t duplicates = 0;
+};
+
+static ST_RunStats Run(std::vector<uint8_t> &screen, std::vector<uint8_t> &frame, uint32_t width, uint32_t height, int32_t pitch, uint32_t changeEvery, int frames, bool bHash, uint64_t seed)
+{
+	ST_RunStats stats;
+	uint64_t prevHash = 0;
+	bool bHavePrev = false;
+	TestRandom rnd(seed); // a new seed per run, replaying the same changes would not change anything
+
+	double t0 = NowSeconds();
+	for (int i = 0; i < frames; i++) {
+		if (changeEvery && i % changeEvery == 0) {
+			// a caret sized change somewhere on the screen
+			uint32_t x = rnd.Below(width - 16), y = rnd.Below(height - 32);
+			for (uint32_t r = 0; r < 32; r++)
+				rnd.Fill(screen.data() + size_t(pitch) * (y + r) + size_t(x) * 4, 16 * 4);
+		}
+
+		if (!bHash) {
+			CopyPlane(frame.data(), pitch, screen.data(), pitch, width * 4, height);
+			++stats.published;
+			continue;
+		}
+
+		uint64_t hash = CopyHashPlane(frame.data(), pitch, screen.data(), pitch, width * 4, height);
+		if (bHavePrev && hash == prevHash) {
+			++stats.duplicates;
+			continue;
+		}
+
+		prevHash = hash;
+		bHavePrev = true;
+		++stats.published;
+	}
+
+	stats.seconds = (NowSeconds() - t0) / frames;
+	return stats;
+}
+
+int main(int argc, char **argv)
+{
+	SelectKernels(MAG_CPU_AUTO);
+	int frames = (argc > 1) ? atoi(argv[1]) : 60;
+
+	const uint32_t sizes[][2] = {{1920, 1080}, {3840, 2160}};
+	const ST_ContentCase cases[] = {{"static", 0}, {"change every 10", 10}, {"change every frame", 1}};
+	uint64_t seed = 1;
+
+	for (auto &size : sizes) {
+		uint32_t width = size[0], height = size[1];
+		int32_t pitch = width * 4;
+		std::vector<uint8_t> screen(size_t(pitch) * height);
+		std::vector<uint8_t> frame(screen.size());
+		TestRandom rnd(1);
+		rnd.Fill(screen.data(), screen.size());
+		memcpy(frame.data(), screen.data(), screen.size()); // fault the pages in
+
+		for (const ST_ContentCase &c : cases) {
+			ST_RunStats copy = Run(screen, frame, width, height, pitch, c.changeEvery, frames, false, ++seed);
+			ST_RunStats hash = Run(screen, frame, width, height, pitch, c.changeEvery, frames, true, ++seed);
+
+			uint64_t expected = c.changeEvery ? (frames + c.changeEvery - 1) / c.changeEvery : 1;
+			CHECK(hash.published == expected);
+			CHECK(hash.published + hash.duplicates == uint64_t(frames));
+
+			printf("%4ux%-4u %-20s copy %7.3f ms  copy+hash %7.3f ms (%+5.1f%%)  published %4llu/%d  duplicates %4llu\n", width, height, c.name, copy.seconds * 1e3, hash.seconds * 1e3,
+			       (hash.seconds / copy.seconds - 1) * 100, (unsigned long long)hash.published, frames, (unsigned long long)hash.duplicates);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "FramePool.hpp"
+#include "TestUtil.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+// Every operator new in the process, the pooled path must not show up here once it is warm
+static std::atomic<uint64_t> s_nAllocs = {0};
+
+void *operator new(size_t size)
+{
+	++s_nAllocs;
+	void *ret = malloc(size ? size : 1);
+	if (!ret)
+		throw std::bad_alloc();
+	return ret;
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+
+#define FRAME_BYTES (1920 * 4 * 1080)
+#define HELD_FRAMES 2 // the consumer keeps the last two frames, more than the old single idle buffer
+
+// Before: shared_ptr frames with a capturing deleter that copies the frame into a std::function task to recycle the buffer
+struct ST_OldFrame {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int32_t pitch = 0;
+	std::shared_ptr<uint8_t> data;
+};
+
+class OldCapture : public std::enable_shared_from_this<OldCapture> {
+public:
+	std::shared_ptr<ST_OldFrame> PushVideo()
+	{
+		RunTasks();
+
+		std::shared_ptr<uint8_t> data;
+		if (!m_IdleList.empty()) {
+			data = m_IdleList.front();
+			m_IdleList.pop_front();
+		} else {
+			data = std::shared_ptr<uint8_t>(new uint8_t[FRAME_BYTES], std::default_delete<uint8_t[]>());
+		}
+
+		std::weak_ptr<OldCapture> wself(shared_from_this());
+		std::shared_ptr<ST_OldFrame> vf(new ST_OldFrame(), [wself](ST_OldFrame *frame) {
+			auto self = wself.lock();
+			if (self) {
+				ST_OldFrame copy = *frame;
+				self->PushTask([self, copy]() {
+					if (self->m_IdleList.size() < 1)
+						self->m_IdleList.push_back(copy.data);
+				});
+			}
+			delete frame;
+		});
+
+		vf->width = 1920;
+		vf->height = 1080;
+		vf->pitch = 1920 * 4;
+		vf->data = data;
+		return vf;
+	}
+
+private:
+	void PushTask(std::function<void()> task)
+	{
+		std::lock_guard<std::recursive_mutex> autoLock(m_lockTask);
+		m_vTaskList.push_back(std::move(task));
+	}
+
+	void RunTasks()
+	{
+		std::vector<std::function<void()>> tasks;
+		{
+			std::lock_guard<std::recursive_mutex> autoLock(m_lockTask);
+			tasks.swap(m_vTaskList);
+		}
+		for (auto &task : tasks)
+			task();
+	}
+
+	std::recursive_mutex m_lockTask;
+	std::vector<std::function<void()>> m_vTaskList;
+	std::deque<std::shared_ptr<uint8_t>> m_IdleList;
+};
+
+struct ST_NewFrame : public PooledFrame {
+	uint32_t width = 0;
+	uint32_t height = 0;
+	int32_t pitch = 0;
+};
+
+static void BenchOld(uint32_t count)
+{
+	std::shared_ptr<OldCapture> capture = std::make_shared<OldCapture>();
+	std::shared_ptr<ST_OldFrame> held[HELD_FRAMES];
+	for (uint32_t i = 0; i < 100; i++)
+		held[i % HELD_FRAMES] = capture->PushVideo();
+
+	uint64_t allocs = s_nAllocs;
+	double t0 = NowSeconds();
+	for (uint32_t i = 0; i < count; i++)
+		held[i % HELD_FRAMES] = capture->PushVideo();
+	double ns = (NowSeconds() - t0) * 1e9 / count;
+	printf("shared_ptr + deleter task: %7.1f ns/frame, %.2f allocations/frame\n", ns, double(s_nAllocs - allocs) / count);
+}
+
+static void BenchPooled(uint32_t count)
+{
+	FramePool<ST_NewFrame> *pool = new FramePool<ST_NewFrame>();
+	ST_NewFrame *held[HELD_FRAMES] = {};
+	auto push = [&](uint32_t i) {
+		ST_NewFrame *vf = pool->Acquire(FRAME_BYTES);
+		vf->width = 1920;
+		vf->height = 1080;
+		vf->pitch = 1920 * 4;
+		if (held[i % HELD_FRAMES])
+			held[i % HELD_FRAMES]->Release();
+		held[i % HELD_FRAMES] = vf;
+	};
+
+	for (uint32_t i = 0; i < 100; i++)
+		push(i);
+
+	uint64_t allocs = s_nAllocs;
+	uint64_t misses = pool->GetStats().misses;
+	double t0 = NowSeconds();
+	for (uint32_t i = 0; i < count; i++)
+		push(i);
+	double ns = (NowSeconds() - t0) * 1e9 / count;
+	printf("pooled intrusive frame:    %7.1f ns/frame, %.2f allocations/frame, %llu buffer misses\n", ns, double(s_nAllocs - allocs) / count,
+	       (unsigned long long)(pool->GetStats().misses - misses));
+
+	for (ST_NewFrame *vf : held)
+		vf->Release();
+	pool->Release();
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 200000;
+	for (int pass = 0; pass < 2; pass++) {
+		BenchOld(count);
+		BenchPooled(count);
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "FrameMailbox.hpp"
+#include "TestUtil.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The handoff PushVideo / PopVideo used before the mailbox: a vector under a recursive_mutex, the newest frame replaces the list
+class MutexHandoff {
+public:
+	void Publish(const std::shared_ptr<int> &frame)
+	{
+		std::lock_guard<std::recursive_mutex> autoLock(m_lock);
+		m_vList.clear();
+		m_vList.push_back(frame);
+	}
+
+	bool Take(std::shared_ptr<int> &out)
+	{
+		std::lock_guard<std::recursive_mutex> autoLock(m_lock);
+		if (m_vList.empty())
+			return false;
+
+		out = m_vList.front();
+		m_vList.erase(m_vList.begin());
+		return true;
+	}
+
+private:
+	std::recursive_mutex m_lock;
+	std::vector<std::shared_ptr<int>> m_vList;
+};
+
+class MailboxHandoff {
+public:
+	void Publish(const std::shared_ptr<int> &frame) { m_Mailbox.Publish(frame); }
+	bool Take(std::shared_ptr<int> &out) { return m_Mailbox.Take(out); }
+
+private:
+	FrameMailbox<std::shared_ptr<int>> m_Mailbox;
+};
+
+// The producer publishes count frames, the consumer polls as fast as it can until the producer is done
+template <class Handoff> static void Run(const char *name, uint64_t count)
+{
+	std::vector<std::shared_ptr<int>> frames;
+	for (int i = 0; i < 8; i++)
+		frames.push_back(std::make_shared<int>(i));
+
+	// uncontended cost of one publish plus one take
+	Handoff single;
+	std::shared_ptr<int> out;
+	double t0 = NowSeconds();
+	for (uint64_t i = 0; i < count; i++) {
+		single.Publish(frames[i & 7]);
+		single.Take(out);
+	}
+	double single_ns = (NowSeconds() - t0) * 1e9 / count;
+
+	Handoff handoff;
+	std::atomic<bool> bDone = {false};
+	uint64_t polls = 0, taken = 0;
+	t0 = NowSeconds();
+	std::thread producer([&]() {
+		for (uint64_t i = 0; i < count; i++)
+			handoff.Publish(frames[i & 7]);
+		bDone = true;
+	});
+	double producer_s = 0; // both threads run for this long
+	while (!bDone.load()) {
+		polls++;
+		if (handoff.Take(out))
+			taken++;
+	}
+	producer.join();
+	producer_s = NowSeconds() - t0;
+
+	printf("%-8s publish+take %6.1f ns | contended: publish %6.1f ns, poll %6.1f ns, %llu frames taken\n", name, single_ns, producer_s * 1e9 / count, producer_s * 1e9 / polls,
+	       (unsigned long long)taken);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t count = (argc > 1) ? strtoull(argv[1], nullptr, 10) : 2000000;
+	for (int pass = 0; pass < 3; pass++) {
+		Run<MutexHandoff>("mutex", count);
+		Run<MailboxHandoff>("mailbox", count);
+	}
+	return 0;
+}
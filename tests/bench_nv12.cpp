@@ -0,0 +1,65 @@
+#include "ColorConvert.h"
+#include "FrameCopy.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <vector>
+
+// NV12 output straight from a pitched surface against copying it to a packed frame first, as the capture did
+// before the conversion read the locked rows. Both with the scalar kernels and with the best the CPU has.
+static double TimeConvert(const std::vector<uint8_t> &src, int32_t srcPitch, std::vector<uint8_t> &packed, uint32_t width, uint32_t height, uint8_t *const planes[3],
+			  const int32_t pitches[3], const ST_YuvCoefs &coefs, bool bCopy, int iterations)
+{
+	double t0 = 0;
+	for (int i = -1; i < iterations; i++) {
+		if (i == 0)
+			t0 = NowSeconds(); // the first round only warms up
+
+		if (bCopy) {
+			CopyPlane(packed.data(), width * 4, src.data(), srcPitch, width * 4, height);
+			ConvertBGRAToYuv(packed.data(), width * 4, width, height, 0, height, MAG_YUV_NV12, planes, pitches, coefs);
+		} else {
+			ConvertBGRAToYuv(src.data(), srcPitch, width, height, 0, height, MAG_YUV_NV12, planes, pitches, coefs);
+		}
+	}
+	return (NowSeconds() - t0) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : 20;
+
+	const uint32_t sizes[][2] = {{1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+	const char *levelNames[] = {"scalar", "SSE2", "SSSE3", "AVX2", "AVX-512"};
+
+	ST_YuvCoefs coefs;
+	CalcYuvCoefs(MAG_MATRIX_BT709, MAG_RANGE_LIMITED, coefs);
+
+	for (auto &size : sizes) {
+		uint32_t width = size[0], height = size[1];
+		int32_t srcPitch = ((width * 4 + 255) & ~255) + 64; // padded rows like a locked surface
+		std::vector<uint8_t> src(size_t(srcPitch) * height);
+		std::vector<uint8_t> packed(size_t(width) * 4 * height);
+		TestRandom rnd(1);
+		rnd.Fill(src.data(), src.size());
+
+		size_t offsets[3];
+		int32_t pitches[3];
+		size_t bytes = CalcYuvLayout(MAG_YUV_NV12, width, height, offsets, pitches);
+		std::vector<uint8_t> fused(bytes), copied(bytes);
+		uint8_t *fusedPlanes[3] = {fused.data() + offsets[0], fused.data() + offsets[1], nullptr};
+		uint8_t *copiedPlanes[3] = {copied.data() + offsets[0], copied.data() + offsets[1], nullptr};
+
+		for (int pass = 0; pass < 2; pass++) {
+			MagCpuLevel level = SelectKernels(pass ? MAG_CPU_AUTO : MAG_CPU_SCALAR);
+			double copy = TimeConvert(src, srcPitch, packed, width, height, copiedPlanes, pitches, coefs, true, iterations);
+			double direct = TimeConvert(src, srcPitch, packed, width, height, fusedPlanes, pitches, coefs, false, iterations);
+			CHECK(memcmp(fused.data(), copied.data(), bytes) == 0);
+
+			printf("%4ux%-4u pitch %5d %-7s  copy+convert %7.3f ms  convert %7.3f ms  %5.2fx  %6.0f Mpix/s\n", width, height, srcPitch, levelNames[level], copy * 1e3,
+			       direct * 1e3, copy / direct, double(width) * height / direct / 1e6);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include "FrameScale.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <vector>
+
+// Downscaling over common capture/output pairs, every filter with the scalar kernels and with the best the CPU has.
+// Prepare is timed separately, it only runs when the size or the filter changes.
+struct ST_ScalePair {
+	uint32_t srcWidth;
+	uint32_t srcHeight;
+	uint32_t dstWidth;
+	uint32_t dstHeight;
+};
+
+static double TimeScale(const FrameScaler &scaler, const uint8_t *src, int32_t srcPitch, uint8_t *dst, int32_t dstPitch, int iterations)
+{
+	scaler.Scale32(src, srcPitch, dst, dstPitch);
+	double t0 = NowSeconds();
+	for (int i = 0; i < iterations; i++)
+		scaler.Scale32(src, srcPitch, dst, dstPitch);
+	return (NowSeconds() - t0) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : 10;
+
+	const ST_ScalePair pairs[] = {
+	    {3840, 2160, 1920, 1080}, {3840, 2160, 1280, 720}, {2560, 1440, 1280, 720}, {1920, 1080, 1280, 720}, {3840, 2160, 320, 180}, {1920, 1080, 160, 90},
+	};
+	const char *filterNames[] = {"box", "bilinear", "area"};
+	const char *levelNames[] = {"scalar", "SSE2", "SSSE3", "AVX2", "AVX-512"};
+
+	for (const ST_ScalePair &p : pairs) {
+		int32_t srcPitch = p.srcWidth * 4, dstPitch = p.dstWidth * 4;
+		std::vector<uint8_t> src(size_t(srcPitch) * p.srcHeight);
+		std::vector<uint8_t> dst(size_t(dstPitch) * p.dstHeight);
+		TestRandom rnd(1);
+		rnd.Fill(src.data(), src.size());
+
+		for (int f = MAG_SCALE_BOX; f <= MAG_SCALE_AREA; f++) {
+			FrameScaler scaler;
+			double t0 = NowSeconds();
+			CHECK(scaler.Prepare((MagScaleFilter)f, p.srcWidth, p.srcHeight, p.dstWidth, p.dstHeight));
+			double prepare = NowSeconds() - t0;
+			CHECK(!scaler.Prepare((MagScaleFilter)f, p.srcWidth, p.srcHeight, p.dstWidth, p.dstHeight));
+
+			SelectKernels(MAG_CPU_SCALAR);
+			double scalar = TimeScale(scaler, src.data(), srcPitch, dst.data(), dstPitch, iterations);
+			MagCpuLevel level = SelectKernels(MAG_CPU_AUTO);
+			double simd = TimeScale(scaler, src.data(), srcPitch, dst.data(), dstPitch, iterations);
+
+			printf("%4ux%-4u -> %4ux%-4u %-8s  prepare %6.3f ms  scalar %7.3f ms  %-7s %7.3f ms  %5.1fx  %6.0f Mpix/s\n", p.srcWidth, p.srcHeight, p.dstWidth, p.dstHeight, filterNames[f],
+			       prepare * 1e3, scalar * 1e3, levelNames[level], simd * 1e3, scalar / simd, double(p.srcWidth) * p.srcHeight / simd / 1e6);
+		}
+	}
+
+	return 0;
+}
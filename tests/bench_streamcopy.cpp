@@ -0,0 +1,67 @@
+#include "FrameCopy.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <vector>
+
+// Temporal against streaming frame copies, and what each leaves of a co-running consumer's working set:
+// the working set is read, a 4K frame is copied, then the time to read the working set again is measured.
+// A temporal copy of 33 MB pushes the working set out of the LLC, a streaming copy should not.
+static uint64_t Touch(const std::vector<uint64_t> &workingSet)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < workingSet.size(); i += 8) // one load per cache line
+		sum += workingSet[i];
+	return sum;
+}
+
+int main(int argc, char **argv)
+{
+	SelectKernels(MAG_CPU_AUTO);
+	int iterations = (argc > 1) ? atoi(argv[1]) : 40;
+
+	const uint32_t width = 3840, height = 2160;
+	const int32_t pitch = width * 4;
+	const size_t bytes = size_t(pitch) * height;
+	const int sources = 8; // rotating sources, so the copy reads from memory as a readback does
+	std::vector<uint8_t> src(bytes * sources, 1);
+	std::vector<uint8_t> dst(bytes * 2, 2);
+
+	const size_t workingSets[] = {1 << 20, 4 << 20, 16 << 20};
+	const char *modeNames[] = {"no copy", "temporal", "streaming"};
+
+	printf("4K frame %.1f MB, MAG_STREAM_COPY_MIN %.1f MB\n", bytes / 1048576.0, MAG_STREAM_COPY_MIN / 1048576.0);
+	for (size_t size : workingSets) {
+		std::vector<uint64_t> workingSet(size / 8, 3);
+		volatile uint64_t sink = 0;
+
+		for (int mode = 0; mode < 3; mode++) {
+			double copyTime = 0, rereadTime = 0;
+			for (int i = 0; i < iterations; i++) {
+				sink = sink + Touch(workingSet) + Touch(workingSet);
+
+				uint8_t *d = dst.data() + bytes * (i & 1);
+				const uint8_t *s = src.data() + bytes * (i % sources);
+				double t0 = NowSeconds();
+				if (mode == 1)
+					CopyPlane(d, pitch, s, pitch, pitch, height);
+				else if (mode == 2)
+					StreamPlane(d, pitch, s, pitch, pitch, height);
+				double t1 = NowSeconds();
+				sink = sink + Touch(workingSet);
+				double t2 = NowSeconds();
+
+				copyTime += t1 - t0;
+				rereadTime += t2 - t1;
+			}
+
+			copyTime /= iterations;
+			rereadTime /= iterations;
+			if (mode)
+				printf("working set %2zu MB  %-9s  copy %6.2f ms %6.2f GB/s  working set re-read %7.3f ms\n", size >> 20, modeNames[mode], copyTime * 1e3, bytes / copyTime / 1e9, rereadTime * 1e3);
+			else
+				printf("working set %2zu MB  %-9s  %-26s  working set re-read %7.3f ms\n", size >> 20, modeNames[mode], "", rereadTime * 1e3);
+		}
+	}
+
+	return 0;
+}
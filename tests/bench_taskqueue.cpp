@@ -0,0 +1,180 @@
+#include "TaskQueue.hpp"
+#include "TestUtil.h"
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Enqueue cost of a setter-sized task (a shared_ptr and a rect), the old std::function list under a recursive mutex
+// against InlineTask in MpscQueue, then burst-to-run latency with coalesced wake-ups.
+// PostMessage is stood in for by a counted condition variable.
+static std::atomic<uint64_t> g_nAllocs = {0};
+
+void *operator new(size_t size)
+{
+	++g_nAllocs;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+struct ST_Rect {
+	long left, top, right, bottom;
+};
+
+struct ST_Target {
+	ST_Rect rc = {};
+};
+
+class WakeEvent {
+public:
+	void Post()
+	{
+		std::lock_guard<std::mutex> autoLock(m_lock);
+		m_nPosted++;
+		m_nTotal++;
+		m_cond.notify_one();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> autoLock(m_lock);
+		m_cond.wait(autoLock, [this]() { return m_nPosted > 0; });
+		m_nPosted--;
+	}
+
+	uint64_t GetTotal()
+	{
+		std::lock_guard<std::mutex> autoLock(m_lock);
+		return m_nTotal;
+	}
+
+private:
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	int m_nPosted = 0;
+	uint64_t m_nTotal = 0;
+};
+
+static void BenchEnqueue(int count)
+{
+	auto target = std::make_shared<ST_Target>();
+	{
+		std::recursive_mutex lock;
+		std::vector<std::function<void()>> list;
+		list.reserve(count);
+		uint64_t allocs = g_nAllocs;
+		double t0 = NowSeconds();
+		for (int i = 0; i < count; i++) {
+			ST_Rect rc = {i, i, i + 100, i + 100};
+			std::function<void()> func = [target, rc]() { target->rc = rc; };
+			std::lock_guard<std::recursive_mutex> autoLock(lock);
+			list.push_back(func);
+		}
+		double t = NowSeconds() - t0;
+		printf("std::function + recursive_mutex  %6.1f ns/task  %.2f allocations/task\n", t / count * 1e9, double(g_nAllocs - allocs) / count);
+	}
+
+	{
+		static MpscQueue<InlineTask, 256> queue;
+		InlineTask out;
+		double t = 0;
+		int pushed = 0;
+		uint64_t allocs = g_nAllocs;
+		while (pushed < count) {
+			double t0 = NowSeconds();
+			for (int i = 0; i < 256; i++) {
+				ST_Rect rc = {i, i, i + 100, i + 100};
+				InlineTask task([target, rc]() { target->rc = rc; });
+				queue.Push(task);
+			}
+			t += NowSeconds() - t0;
+			pushed += 256;
+			while (queue.Pop(out))
+				out.Clear();
+		}
+		printf("InlineTask + MpscQueue           %6.1f ns/task  %.2f allocations/task\n", t / pushed * 1e9, double(g_nAllocs - allocs) / pushed);
+	}
+}
+
+static void BenchWake(int producers, int bursts, int burst)
+{
+	static MpscQueue<InlineTask, 256> queue;
+	WakeEvent event;
+	std::atomic<bool> posted = {false};
+	std::atomic<bool> stop = {false};
+	std::atomic<uint64_t> runs = {0};
+	std::mutex latencyLock;
+	std::vector<double> latencies;
+
+	std::thread consumer([&]() {
+		InlineTask task;
+		while (!stop) {
+			event.Wait();
+			posted.exchange(false, std::memory_order_acq_rel);
+			while (queue.Pop(task)) {
+				task();
+				task.Clear();
+			}
+		}
+	});
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&]() {
+			for (int b = 0; b < bursts; b++) {
+				double start = NowSeconds();
+				for (int i = 0; i < burst; i++) {
+					bool bLast = (i == burst - 1);
+					InlineTask task([&, start, bLast]() {
+						++runs;
+						if (bLast) {
+							std::lock_guard<std::mutex> autoLock(latencyLock);
+							latencies.push_back(NowSeconds() - start);
+						}
+					});
+
+					while (!queue.Push(task))
+						std::this_thread::yield();
+
+					if (!posted.exchange(true, std::memory_order_acq_rel))
+						event.Post();
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		});
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+	while (runs < uint64_t(producers) * bursts * burst)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	stop = true;
+	uint64_t notifications = event.GetTotal();
+	event.Post();
+	consumer.join();
+
+	CHECK(runs == uint64_t(producers) * bursts * burst);
+	std::sort(latencies.begin(), latencies.end());
+	printf("%d producers, bursts of %d: %llu wake-ups for %d tasks (%.2f per burst), burst to last task run median %.1f us, p99 %.1f us\n", producers, burst,
+	       (unsigned long long)notifications, producers * bursts * burst, double(notifications) / (producers * bursts), latencies[latencies.size() / 2] * 1e6,
+	       latencies[latencies.size() * 99 / 100] * 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	int count = (argc > 1) ? atoi(argv[1]) : 200000;
+
+	BenchEnqueue(count);
+	BenchWake(1, 3000, 8);
+	BenchWake(3, 3000, 8);
+	BenchWake(3, 1000, 64);
+	return 0;
+}
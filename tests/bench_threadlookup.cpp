@@ -0,0 +1,94 @@
+#include "TestUtil.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The capture lookup of the PresentEx hook with many presenting threads: the old FindMagnifier
+// (recursive mutex, std::map by thread id, shared_ptr copy) against the thread_local pointer the magnifier thread sets.
+// Half of the threads stand in for devices of the host application, they find nothing.
+// bench_threadlookup [lookups], split over the threads of each run.
+struct ST_Capture {
+	std::atomic<uint64_t> presents = {0};
+	void OnPresent() { presents.fetch_add(1, std::memory_order_relaxed); }
+};
+
+static std::recursive_mutex s_lockList;
+static std::map<uint32_t, std::shared_ptr<ST_Capture>> s_mapCaptures;
+static thread_local ST_Capture *t_pCurrent = nullptr;
+
+static std::shared_ptr<ST_Capture> FindCapture(uint32_t threadId)
+{
+	std::lock_guard<std::recursive_mutex> autoLock(s_lockList);
+	auto it = s_mapCaptures.find(threadId);
+	return (it != s_mapCaptures.end()) ? it->second : nullptr;
+}
+
+static double Run(int threads, uint64_t lookups, bool bThreadLocal)
+{
+	std::vector<std::shared_ptr<ST_Capture>> captures;
+	s_mapCaptures.clear();
+	for (int i = 0; i < threads; i++) {
+		captures.push_back(std::make_shared<ST_Capture>());
+		if (i % 2 == 0)
+			s_mapCaptures[1000 + i] = captures.back(); // odd threads present for the host application
+	}
+	for (uint32_t i = 0; i < 64; i++)
+		s_mapCaptures[i + 1] = std::make_shared<ST_Capture>(); // captures of other threads
+
+	std::atomic<int> ready = {0};
+	std::atomic<bool> go = {false};
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; i++) {
+		workers.emplace_back([&, i]() {
+			if (bThreadLocal && i % 2 == 0)
+				t_pCurrent = captures[i].get(); // what MagnifierThread does on start
+
+			++ready;
+			while (!go.load())
+				std::this_thread::yield();
+
+			for (uint64_t k = 0; k < lookups / threads; k++) {
+				if (bThreadLocal) {
+					ST_Capture *capture = t_pCurrent;
+					if (capture)
+						capture->OnPresent();
+				} else {
+					std::shared_ptr<ST_Capture> capture = FindCapture(1000 + i);
+					if (capture)
+						capture->OnPresent();
+				}
+			}
+		});
+	}
+
+	while (ready.load() < threads)
+		std::this_thread::yield();
+	double t0 = NowSeconds();
+	go = true;
+	for (std::thread &worker : workers)
+		worker.join();
+	double t = NowSeconds() - t0;
+
+	uint64_t presents = 0;
+	for (int i = 0; i < threads; i += 2)
+		presents += captures[i]->presents;
+	CHECK(presents == (lookups / threads) * ((threads + 1) / 2));
+	return t / (lookups / threads * threads);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t lookups = (argc > 1) ? strtoull(argv[1], nullptr, 0) : 4000000;
+
+	printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	printf("threads  mutex + map + shared_ptr  thread_local\n");
+	for (int threads : {1, 2, 4, 8, 16, 32, 64}) {
+		double locked = Run(threads, lookups, false);
+		double local = Run(threads, lookups, true);
+		printf("%7d  %19.1f ns  %9.1f ns\n", threads, locked * 1e9, local * 1e9);
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "BandPool.h"
+#include "FrameScale.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <thread>
+#include <vector>
+
+// Every row is covered by exactly one band and every band starts on the alignment
+static void CheckCoverage(BandQueue &queue, TestRandom &rnd, int iterations)
+{
+	for (int i = 0; i < iterations; i++) {
+		uint32_t rows = rnd.Below(5000);
+		uint32_t align = 1 + rnd.Below(4);
+		std::vector<std::atomic<uint32_t>> hits(rows);
+		for (auto &hit : hits)
+			hit.store(0);
+
+		queue.Run(rows, align, [&](uint32_t begin, uint32_t end) {
+			CHECK(begin % align == 0);
+			CHECK(begin < end && end <= rows);
+			for (uint32_t row = begin; row < end; row++)
+				hits[row].fetch_add(1, std::memory_order_relaxed);
+		});
+
+		for (uint32_t row = 0; row < rows; row++)
+			CHECK(hits[row].load() == 1);
+	}
+}
+
+static void TestCoverage()
+{
+	BandPool pool;
+	BandQueue queue(&pool);
+	TestRandom rnd(18);
+
+	const uint32_t threads[] = {0, 1, 2, 3, 8, MAG_BAND_MAX_THREADS, 1, 0};
+	for (uint32_t count : threads) {
+		pool.SetThreads(count);
+		CHECK(pool.GetThreads() == count);
+		for (uint32_t limit : {0u, 1u, 2u}) {
+			queue.SetMaxThreads(limit);
+			CheckCoverage(queue, rnd, 200);
+		}
+	}
+
+	// one queue per capture, all submitting at the same time
+	pool.SetThreads(3);
+	std::vector<std::thread> captures;
+	for (int i = 0; i < 4; i++) {
+		captures.emplace_back([&pool, i]() {
+			BandQueue own(&pool);
+			TestRandom local(100 + i);
+			CheckCoverage(own, local, 300);
+			CHECK(own.GetStats().waitMicros < 60 * 1000000ull);
+		});
+	}
+	for (std::thread &capture : captures)
+		capture.join();
+
+	ST_BandPoolStats stats = pool.GetStats();
+	CHECK(stats.threads == 3);
+	CHECK(stats.queues == 1); // only queue is left, the captures detached
+	CHECK(stats.queuedBands == 0);
+	CHECK(stats.stolenBands <= stats.bands);
+}
+
+// A banded scale writes the same pixels as the serial one
+static void TestBandedScale()
+{
+	BandPool pool;
+	pool.SetThreads(4);
+	BandQueue queue(&pool);
+
+	const uint32_t srcWidth = 1000, srcHeight = 700, dstWidth = 613, dstHeight = 389;
+	FrameScaler scaler;
+	scaler.Prepare(MAG_SCALE_AREA, srcWidth, srcHeight, dstWidth, dstHeight);
+
+	std::vector<uint8_t> src(size_t(srcWidth) * 4 * srcHeight);
+	TestRandom(5).Fill(src.data(), src.size());
+	std::vector<uint8_t> serial(size_t(dstWidth) * 4 * dstHeight), banded(serial.size());
+
+	scaler.Scale32(src.data(), srcWidth * 4, serial.data(), dstWidth * 4);
+	queue.Run(dstHeight, 1, [&](uint32_t begin, uint32_t end) { scaler.Scale32Rows(src.data(), srcWidth * 4, banded.data(), dstWidth * 4, begin, end); });
+	CHECK(serial == banded);
+}
+
+int main()
+{
+	SelectKernels(MAG_CPU_AUTO);
+
+	TestCoverage();
+	TestBandedScale();
+
+	printf("test_bandpool OK\n");
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include "DirtyRects.h"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <vector>
+
+static bool Contains(const ST_DirtyRect &rc, int32_t x, int32_t y)
+{
+	return x >= rc.left && x < rc.right && y >= rc.top && y < rc.bottom;
+}
+
+static bool Overlaps(const ST_DirtyRect &a, const ST_DirtyRect &b)
+{
+	return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+// The list stays within the frame, below the cap, without overlaps, and covers every pixel that was added
+static void CheckList(const ST_DirtyRectList &list, const std::vector<uint8_t> &covered, int32_t width, int32_t height)
+{
+	CHECK(list.count <= MAG_MAX_DIRTY_RECTS);
+	for (uint32_t i = 0; i < list.count; i++) {
+		const ST_DirtyRect &rc = list.rects[i];
+		CHECK(rc.left >= 0 && rc.top >= 0 && rc.right <= width && rc.bottom <= height && rc.left < rc.right && rc.top < rc.bottom);
+		for (uint32_t j = i + 1; j < list.count; j++)
+			CHECK(!Overlaps(rc, list.rects[j]));
+	}
+
+	for (int32_t y = 0; y < height; y++) {
+		for (int32_t x = 0; x < width; x++) {
+			if (!covered[size_t(y) * width + x])
+				continue;
+
+			bool bInside = false;
+			for (uint32_t i = 0; i < list.count && !bInside; i++)
+				bInside = Contains(list.rects[i], x, y);
+			CHECK(bInside);
+		}
+	}
+}
+
+static ST_DirtyRect RandomRect(TestRandom &rnd, int32_t width, int32_t height)
+{
+	ST_DirtyRect rc;
+	rc.left = (int32_t)rnd.Below(width + 20) - 10;
+	rc.top = (int32_t)rnd.Below(height + 20) - 10;
+	rc.right = rc.left + (int32_t)rnd.Below(30);
+	rc.bottom = rc.top + (int32_t)rnd.Below(30);
+	return rc;
+}
+
+static void Mark(std::vector<uint8_t> &covered, const ST_DirtyRect &rc, int32_t width, int32_t height)
+{
+	for (int32_t y = rc.top; y < rc.bottom; y++)
+		for (int32_t x = rc.left; x < rc.right; x++)
+			if (x >= 0 && y >= 0 && x < width && y < height)
+				covered[size_t(y) * width + x] = 1;
+}
+
+static void TestAddAndMerge(TestRandom &rnd)
+{
+	const int32_t width = 97, height = 61;
+	for (int round = 0; round < 1000; round++) {
+		ST_DirtyRectList list, other;
+		std::vector<uint8_t> covered(size_t(width) * height, 0);
+
+		uint32_t count = rnd.Below(40);
+		for (uint32_t i = 0; i < count; i++) {
+			ST_DirtyRect rc = RandomRect(rnd, width, height);
+			Mark(covered, rc, width, height);
+			AddDirtyRect(list, rc, width, height);
+		}
+		CheckList(list, covered, width, height);
+
+		count = rnd.Below(20);
+		for (uint32_t i = 0; i < count; i++) {
+			ST_DirtyRect rc = RandomRect(rnd, width, height);
+			Mark(covered, rc, width, height);
+			AddDirtyRect(other, rc, width, height);
+		}
+		MergeDirtyRects(list, other, width, height);
+		CheckList(list, covered, width, height);
+	}
+
+	// clipping and the full frame
+	ST_DirtyRectList list;
+	AddDirtyRect(list, ST_DirtyRect{-5, -5, 0, 10}, width, height);
+	AddDirtyRect(list, ST_DirtyRect{width, 0, width + 5, 5}, width, height);
+	CHECK(list.count == 0);
+	SetFullDirty(list, width, height);
+	CHECK(list.count == 1 && list.rects[0].right == width && list.rects[0].bottom == height);
+	SetFullDirty(list, 0, height);
+	CHECK(list.count == 0);
+}
+
+// Every source pixel inside a rect maps into a scaled rect, grown by the margin
+static void TestScale(TestRandom &rnd)
+{
+	for (int round = 0; round < 300; round++) {
+		int32_t srcWidth = 50 + (int32_t)rnd.Below(400), srcHeight = 50 + (int32_t)rnd.Below(300);
+		int32_t dstWidth = 8 + (int32_t)rnd.Below(srcWidth), dstHeight = 8 + (int32_t)rnd.Below(srcHeight);
+
+		ST_DirtyRectList src, dst;
+		for (uint32_t i = rnd.Below(8); i > 0; i--)
+			AddDirtyRect(src, RandomRect(rnd, srcWidth, srcHeight), srcWidth, srcHeight);
+
+		ScaleDirtyRects(dst, src, srcWidth, srcHeight, dstWidth, dstHeight, 1);
+		for (uint32_t i = 0; i < src.count; i++) {
+			const ST_DirtyRect &rc = src.rects[i];
+			int32_t x = (int32_t)((int64_t)rc.left * dstWidth / srcWidth), y = (int32_t)((int64_t)rc.top * dstHeight / srcHeight);
+			int32_t x1 = (int32_t)(((int64_t)rc.right * dstWidth - 1) / srcWidth), y1 = (int32_t)(((int64_t)rc.bottom * dstHeight - 1) / srcHeight);
+			bool bFirst = false, bLast = false;
+			for (uint32_t j = 0; j < dst.count; j++) {
+				bFirst = bFirst || Contains(dst.rects[j], x, y);
+				bLast = bLast || Contains(dst.rects[j], x1, y1);
+			}
+			CHECK(bFirst && bLast);
+		}
+	}
+}
+
+// Only the listed rects change, everything else of the persistent frame stays
+static void TestCopy(TestRandom &rnd)
+{
+	for (int round = 0; round < 200; round++) {
+		int32_t width = 1 + (int32_t)rnd.Below(300), height = 1 + (int32_t)rnd.Below(200);
+		int32_t srcPitch = width * 4 + (int32_t)rnd.Below(4) * 16, dstPitch = width * 4 + (int32_t)rnd.Below(4) * 64;
+		std::vector<uint8_t> src(size_t(srcPitch) * height), dst(size_t(dstPitch) * height), before;
+		rnd.Fill(src.data(), src.size());
+		rnd.Fill(dst.data(), dst.size());
+		before = dst;
+
+		ST_DirtyRectList list;
+		for (uint32_t i = rnd.Below(10); i > 0; i--)
+			AddDirtyRect(list, RandomRect(rnd, width, height), width, height);
+
+		CopyDirtyRects32(dst.data(), dstPitch, src.data(), srcPitch, list);
+		for (int32_t y = 0; y < height; y++) {
+			for (int32_t x = 0; x < width; x++) {
+				bool bDirty = false;
+				for (uint32_t i = 0; i < list.count && !bDirty; i++)
+					bDirty = Contains(list.rects[i], x, y);
+
+				const uint8_t *expect = bDirty ? &src[size_t(srcPitch) * y + size_t(x) * 4] : &before[size_t(dstPitch) * y + size_t(x) * 4];
+				CHECK(memcmp(&dst[size_t(dstPitch) * y + size_t(x) * 4], expect, 4) == 0);
+			}
+		}
+	}
+}
+
+int main()
+{
+	SelectKernels(MAG_CPU_AUTO);
+
+	TestRandom rnd(0x5EED0006);
+	TestAddAndMerge(rnd);
+	TestScale(rnd);
+	TestCopy(rnd);
+
+	printf("test_dirtyrects OK\n");
+	return 0;
+}
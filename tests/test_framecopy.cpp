@@ -0,0 +1,67 @@
+#include "FrameCopy.h"
+#include "FrameAlignment.hpp"
+#include "KernelDispatch.h"
+#include "TestUtil.h"
+#include <string.h>
+#include <vector>
+
+#define GUARD 64
+#define GUARD_BYTE 0xA5
+
+// Crops a random sub-rectangle out of a random pitched surface, as CaptureDX9 and PushVideo do
+static void TestCrop(TestRandom &rnd)
+{
+	uint32_t width = 1 + rnd.Below(700);
+	uint32_t height = 1 + rnd.Below(300);
+	int32_t srcPitch = (int32_t)(width * 4 + rnd.Below(3) * 64 + rnd.Below(16) * 4);
+	std::vector<uint8_t> surface(size_t(srcPitch) * height);
+	rnd.Fill(surface.data(), surface.size());
+
+	uint32_t left = rnd.Below(width);
+	uint32_t top = rnd.Below(height);
+	uint32_t cropWidth = 1 + rnd.Below(width - left);
+	uint32_t cropHeight = 1 + rnd.Below(height - top);
+	uint32_t rowBytes = cropWidth * 4;
+
+	MagPitchPolicy policy = (MagPitchPolicy)rnd.Below(MAG_PITCH_PACKED + 1);
+	int32_t dstPitch = CalcFramePitch(rowBytes, srcPitch, policy);
+	CHECK(dstPitch >= (int32_t)rowBytes);
+
+	// StreamPlane must leave exactly the same bytes as CopyPlane, gaps between rows included
+	for (int stream = 0; stream < 2; stream++) {
+		std::vector<uint8_t> frame(size_t(dstPitch) * cropHeight + GUARD, GUARD_BYTE);
+		const uint8_t *src = surface.data() + size_t(srcPitch) * top + size_t(left) * 4;
+		if (stream)
+			StreamPlane(frame.data(), dstPitch, src, srcPitch, rowBytes, cropHeight);
+		else
+			CopyPlane(frame.data(), dstPitch, src, srcPitch, rowBytes, cropHeight);
+
+		for (uint32_t y = 0; y < cropHeight; y++) {
+			const uint8_t *row = frame.data() + size_t(dstPitch) * y;
+			CHECK(memcmp(row, src + size_t(srcPitch) * y, rowBytes) == 0);
+
+			// only the rowBytes of each row are written, not the padding after it and nothing past the last row
+			const uint8_t *end = (y + 1 < cropHeight) ? row + dstPitch : frame.data() + frame.size();
+			for (const uint8_t *p = row + rowBytes; p < end; p++)
+				CHECK(*p == GUARD_BYTE);
+		}
+	}
+}
+
+int main()
+{
+	// every streaming variant the CPU has, then the one Init would pick
+	const MagCpuLevel levels[] = {MAG_CPU_SCALAR, MAG_CPU_SSE2, MAG_CPU_AVX2, MAG_CPU_AUTO};
+	for (MagCpuLevel level : levels) {
+		if (level != MAG_CPU_AUTO && level > GetSupportedCpuLevel())
+			continue;
+
+		SelectKernels(level);
+		TestRandom rnd(0x5EED0005);
+		for (int i = 0; i < 1000; i++)
+			TestCrop(rnd);
+	}
+
+	printf("test_framecopy OK\n");
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "FramePool.hpp"
+#include "TestUtil.h"
+#include <thread>
+
+struct ST_TestFrame : public PooledFrame {
+	static int s_nResets;
+	int tag = 0;
+	void Reset() override
+	{
+		tag = 0;
+		++s_nResets;
+	}
+};
+int ST_TestFrame::s_nResets = 0;
+
+static void TestReuse()
+{
+	FramePool<ST_TestFrame> *pool = new FramePool<ST_TestFrame>(2);
+
+	ST_TestFrame *a = pool->Acquire(1000000);
+	CHECK(a->data && a->capacity >= 1000000 && ((uintptr_t)a->data % MAG_CACHE_LINE) == 0);
+	uint8_t *data = a->data;
+	a->tag = 7;
+	a->Release();
+	CHECK(ST_TestFrame::s_nResets == 1);
+
+	// a slightly smaller region lands in the same size class
+	ST_TestFrame *b = pool->Acquire(1000000 - 7680);
+	CHECK(b == a && b->data == data && b->tag == 0);
+	CHECK(pool->GetStats().hits == 1 && pool->GetStats().misses == 1);
+
+	// twice the size needs a new buffer
+	b->Release();
+	ST_TestFrame *c = pool->Acquire(2000000);
+	CHECK(c->capacity >= 2000000 && pool->GetStats().misses == 2);
+
+	// page aligned buffers replace cache line aligned ones
+	c->Release();
+	pool->SetAlignment(MAG_PAGE_SIZE);
+	ST_TestFrame *d = pool->Acquire(2000000);
+	CHECK(((uintptr_t)d->data % MAG_PAGE_SIZE) == 0 && d->alignment == MAG_PAGE_SIZE);
+	d->Release();
+
+	// never more idle frames than the depth
+	ST_TestFrame *frames[4];
+	for (int i = 0; i < 4; i++)
+		frames[i] = pool->Acquire(4096);
+	CHECK(pool->GetStats().highWater == 4);
+	for (int i = 0; i < 4; i++)
+		frames[i]->Release();
+	pool->Acquire(4096)->Release();
+	CHECK(pool->GetStats().idle <= 2);
+
+	pool->Release();
+}
+
+// A capture region shrinking from 4K to 720p: the 4K buffers are recycled instead of staying pinned
+// while every Acquire allocates a new one
+static void TestShrink()
+{
+	const size_t big = 3840 * 2160 * 4, small = 1280 * 720 * 4;
+	FramePool<ST_TestFrame> *pool = new FramePool<ST_TestFrame>(3);
+
+	ST_TestFrame *frames[3];
+	for (int i = 0; i < 3; i++)
+		frames[i] = pool->Acquire(big);
+	for (int i = 0; i < 3; i++)
+		frames[i]->Release();
+
+	// the consumer holds the previous frame while the next one is captured
+	ST_TestFrame *held = nullptr;
+	for (int i = 0; i < 100; i++) {
+		ST_TestFrame *frame = pool->Acquire(small);
+		CHECK(frame->capacity >= small && frame->capacity < big);
+		if (held)
+			held->Release();
+		held = frame;
+	}
+	held->Release();
+
+	ST_FramePoolStats stats = pool->GetStats();
+	CHECK(stats.misses <= 3 + 2);
+	CHECK(stats.hits >= 100 - 2);
+
+	// every idle frame is of the new size, taking them all does not allocate
+	uint64_t misses = stats.misses;
+	for (int i = 0; i < 3; i++) {
+		frames[i] = pool->Acquire(small);
+		CHECK(frames[i]->capacity < big);
+	}
+	CHECK(pool->GetStats().misses <= misses + 1);
+	for (int i = 0; i < 3; i++)
+		frames[i]->Release();
+
+	// a frame of the old size returned late does not push out one of the current size
+	pool->SetDepth(2);
+	ST_TestFrame *late = pool->Acquire(big);
+	ST_TestFrame *a = pool->Acquire(small);
+	ST_TestFrame *b = pool->Acquire(small);
+	a->Release();
+	b->Release();
+	late->Release();
+	misses = pool->GetStats().misses;
+	a = pool->Acquire(small);
+	b = pool->Acquire(small);
+	CHECK(pool->GetStats().misses == misses);
+	a->Release();
+	b->Release();
+
+	pool->Release();
+}
+
+// The last reference may go away on any thread and after the owner dropped the pool
+static void TestRemoteRelease()
+{
+	FramePool<ST_TestFrame> *pool = new FramePool<ST_TestFrame>(3);
+	const int rounds = 20000;
+
+	for (int i = 0; i < rounds; i++) {
+		ST_TestFrame *vf = pool->Acquire(65536);
+		vf->AddRef();
+		std::thread consumer([vf]() {
+			vf->Release();
+			vf->Release();
+		});
+		consumer.join();
+	}
+
+	ST_FramePoolStats stats = pool->GetStats();
+	CHECK(stats.hits == rounds - 1 && stats.misses == 1);
+
+	ST_TestFrame *outlive = pool->Acquire(65536);
+	pool->Release();
+	std::thread([outlive]() { outlive->Release(); }).join(); // deletes the pool
+}
+
+int main()
+{
+	TestReuse();
+	TestShrink();
+	TestRemoteRelease();
+	printf("test_framepool OK\n");
+	return 0;
+}
@@ -0,0 +1,42 @@
+#include "KernelCheck.h"
+#include "TestUtil.h"
+#include <string.h>
+
+// Every SIMD level of every kernel against the scalar output, see KernelCheck.h.
+// test_kernels [seed [cases]] [--measure]: the seed is printed so a failing run can be repeated,
+// --measure adds the 1080p throughput of each level.
+int main(int argc, char **argv)
+{
+	uint32_t seed = 1;
+	uint32_t cases = 500;
+	bool bMeasure = false;
+	int position = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--measure"))
+			bMeasure = true;
+		else if (position++ == 0)
+			seed = (uint32_t)strtoul(argv[i], nullptr, 0);
+		else
+			cases = (uint32_t)strtoul(argv[i], nullptr, 0);
+	}
+
+	printf("seed %u, %u cases per kernel, supported level %s\n", seed, cases, GetCpuLevelName(GetSupportedCpuLevel()));
+
+	std::vector<ST_KernelCheckResult> results;
+	bool bMatch = CheckKernels(cases, seed, bMeasure, &results);
+
+	for (const ST_KernelCheckResult &result : results) {
+		printf("%-22s %-8s %s", result.name, GetCpuLevelName(result.level), result.mismatches ? "MISMATCH" : "ok");
+		if (result.mismatches)
+			printf(" (%u of %u cases)", result.mismatches, result.cases);
+		if (bMeasure)
+			printf("  %6.2f GB/s", result.gbps);
+		printf("\n");
+	}
+
+	CHECK(!results.empty());
+	if (!bMatch)
+		printf("FAIL: rerun with test_kernels %u %u\n", seed, cases);
+
+	return bMatch ? 0 : 1;
+}
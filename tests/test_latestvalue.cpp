@@ -0,0 +1,97 @@
+#include "LatestValue.hpp"
+#include "TestUtil.h"
+#include <thread>
+#include <vector>
+
+struct ST_Region {
+	long left, top, right, bottom;
+};
+
+static void TestLatestWins()
+{
+	LatestValue<int> value;
+	int out = -1;
+	CHECK(!value.Take(out));
+	CHECK(out == -1);
+
+	CHECK(value.Set(1));
+	CHECK(!value.Set(2)); // 1 was never taken
+	CHECK(!value.Set(3));
+	CHECK(value.GetVersion() == 3);
+
+	CHECK(value.Take(out));
+	CHECK(out == 3);
+	CHECK(!value.Take(out)); // nothing new
+
+	CHECK(value.Set(4));
+	CHECK(value.Take(out));
+	CHECK(out == 4);
+
+	// values that own memory are moved out, not shared
+	LatestValue<std::vector<int>> list;
+	list.Set(std::vector<int>(1000, 7));
+	std::vector<int> taken;
+	CHECK(list.Take(taken));
+	CHECK(taken.size() == 1000 && taken[999] == 7);
+}
+
+// Two setters dragging a region against a consumer ticking every 100 us.
+// Every Set is either taken or reported as coalesced, and no taken region is torn or goes back in time.
+static void TestConcurrent()
+{
+	const long sets = 100000;
+	LatestValue<ST_Region> region;
+	std::atomic<long> coalesced = {0};
+	std::atomic<int> running = {2};
+	long taken = 0;
+	long last[2] = {-1, -1};
+	bool bValid = true;
+
+	std::thread consumer([&]() {
+		for (;;) {
+			bool bLastTick = (running.load() == 0);
+			ST_Region rc;
+			if (region.Take(rc)) {
+				taken++;
+				int producer = (int)rc.top;
+				if (rc.left != rc.right || rc.top != rc.bottom || rc.left <= last[producer])
+					bValid = false;
+				last[producer] = rc.left;
+			}
+
+			if (bLastTick)
+				break;
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	});
+
+	std::vector<std::thread> setters;
+	for (long p = 0; p < 2; p++) {
+		setters.emplace_back([&, p]() {
+			for (long i = 0; i < sets; i++) {
+				if (!region.Set(ST_Region{i, p, i, p}))
+					++coalesced;
+			}
+			--running;
+		});
+	}
+
+	for (std::thread &setter : setters)
+		setter.join();
+	consumer.join();
+
+	CHECK(bValid);
+	CHECK(taken + coalesced == 2 * sets);
+	CHECK(taken >= 1 && coalesced > 0);
+	CHECK(region.GetVersion() == uint32_t(2 * sets));
+	printf("%ld sets, %ld taken, %ld coalesced\n", 2 * sets, taken, (long)coalesced);
+}
+
+int main()
+{
+	TestLatestWins();
+	TestConcurrent();
+
+	printf("test_latestvalue OK\n");
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "FrameMailbox.hpp"
+#include "TestUtil.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// Counts live instances, the mailbox must not keep frames alive it has already dropped
+struct TestFrame {
+	static std::atomic<int> s_nLive;
+	explicit TestFrame(uint64_t v) : value(v) { ++s_nLive; }
+	~TestFrame() { --s_nLive; }
+	uint64_t value;
+};
+std::atomic<int> TestFrame::s_nLive = {0};
+
+static void TestLatestWins()
+{
+	FrameMailbox<std::shared_ptr<TestFrame>> mailbox;
+	std::shared_ptr<TestFrame> out;
+	CHECK(!mailbox.HasFresh() && !mailbox.Take(out));
+
+	mailbox.Publish(std::make_shared<TestFrame>(1));
+	mailbox.Publish(std::make_shared<TestFrame>(2));
+	mailbox.Publish(std::make_shared<TestFrame>(3));
+	CHECK(mailbox.HasFresh());
+	CHECK(TestFrame::s_nLive == 1); // replaced frames are dropped by Publish
+
+	CHECK(mailbox.Take(out) && out->value == 3);
+	CHECK(!mailbox.HasFresh() && !mailbox.Take(out) && out->value == 3);
+
+	// publishing nothing clears the mailbox, a consumer sees an empty frame
+	mailbox.Publish(std::make_shared<TestFrame>(4));
+	mailbox.Publish(nullptr);
+	CHECK(mailbox.Take(out) && !out);
+	CHECK(TestFrame::s_nLive == 0);
+}
+
+// One producer at full speed, one polling consumer: frames arrive in order, nothing is seen twice, the last one always arrives
+static void TestStress()
+{
+	const uint64_t count = 1000000;
+	FrameMailbox<std::shared_ptr<TestFrame>> mailbox;
+	std::atomic<bool> bDone = {false};
+
+	std::thread producer([&]() {
+		for (uint64_t i = 1; i <= count; i++)
+			mailbox.Publish(std::make_shared<TestFrame>(i));
+		bDone = true;
+	});
+
+	uint64_t last = 0, taken = 0;
+	std::shared_ptr<TestFrame> out;
+	for (;;) {
+		bool bFinished = bDone.load();
+		while (mailbox.Take(out)) {
+			CHECK(out && out->value > last);
+			last = out->value;
+			taken++;
+		}
+		if (bFinished)
+			break;
+		std::this_thread::yield();
+	}
+
+	producer.join();
+	CHECK(!mailbox.Take(out));
+	CHECK(last == count);
+	out = nullptr;
+	CHECK(TestFrame::s_nLive == 0);
+	printf("stress: %llu published, %llu taken, in order\n", (unsigned long long)count, (unsigned long long)taken);
+}
+
+int main()
+{
+	TestLatestWins();
+	TestStress();
+	printf("test_mailbox OK\n");
+	return 0;
+}
@@ -0,0 +1,136 @@
+#include "CaptureScheduler.h"
+#include "TestUtil.h"
+
+#define NS_PER_SEC 1000000000ull
+
+static void TestDeadlines()
+{
+	CaptureScheduler scheduler;
+
+	// exact rational deadlines, no accumulated rounding
+	scheduler.Start(30000, 1001, 5);
+	CHECK(scheduler.IsRunning());
+	CHECK(scheduler.GetDeadline(1) == 5 + 33366666);
+	CHECK(scheduler.GetDeadline(30000) == 5 + 1001 * NS_PER_SEC);
+	CHECK(scheduler.GetDeadline(30000 * 100) == 5 + 100 * 1001 * NS_PER_SEC);
+
+	scheduler.Start(60, 1, 0);
+	CHECK(scheduler.GetDeadline(1) == 16666666);
+	CHECK(scheduler.GetDeadline(60) == NS_PER_SEC);
+
+	// reduced before use
+	scheduler.Start(120, 2, 0);
+	CHECK(scheduler.GetDeadline(60) == NS_PER_SEC);
+}
+
+// One simulated hour at 59.94 with every wake-up 0-2 ms late: no tick is lost or skipped
+static void TestJitter()
+{
+	CaptureScheduler scheduler;
+	TestRandom rnd(23);
+	scheduler.Start(60000, 1001, 1000);
+
+	const uint64_t hour = 3600 * NS_PER_SEC;
+	uint64_t now = 1000;
+	while (now < 1000 + hour) {
+		now += scheduler.GetWait(now) + rnd.Below(2000000);
+		scheduler.OnTick(now);
+	}
+
+	ST_ScheduleStats stats = scheduler.GetStats();
+	double expected = 3600.0 * 60000 / 1001;
+	CHECK(stats.skippedTicks == 0);
+	CHECK((double)stats.ticks >= expected - 1 && (double)stats.ticks <= expected + 1);
+	CHECK(stats.maxLateness < 2000000);
+	CHECK(stats.totalLateness / stats.ticks < 1100000);
+}
+
+// A stall skips the missed deadlines instead of bursting, later deadlines keep their place
+static void TestStall()
+{
+	CaptureScheduler scheduler;
+	scheduler.Start(30, 1, 0);
+
+	uint64_t now = scheduler.GetDeadline(1);
+	CHECK(scheduler.OnTick(now));
+	CHECK(!scheduler.OnTick(now));
+
+	now = scheduler.GetDeadline(2) + 100000000; // 100 ms late
+	CHECK(scheduler.OnTick(now));
+	CHECK(!scheduler.OnTick(now));
+
+	ST_ScheduleStats stats = scheduler.GetStats();
+	CHECK(stats.ticks == 2);
+	CHECK(stats.skippedTicks == 3);
+	CHECK(stats.lastLateness == 100000000);
+	CHECK(scheduler.GetDeadline(6) > now);
+	CHECK(scheduler.GetWait(now) == scheduler.GetDeadline(6) - now);
+
+	CHECK(!scheduler.OnTick(scheduler.GetDeadline(6) - 1));
+	CHECK(scheduler.OnTick(scheduler.GetDeadline(6)));
+
+	scheduler.ResetStats();
+	CHECK(scheduler.GetStats().ticks == 0 && scheduler.GetStats().skippedTicks == 0);
+
+	scheduler.Stop();
+	CHECK(!scheduler.OnTick(now + 3600 * NS_PER_SEC));
+}
+
+// The largest rate after clamping, a month after the start: the deadline math must not overflow
+static void TestLongRun()
+{
+	CaptureScheduler scheduler;
+	scheduler.Start(MAG_SCHEDULE_MAX_NUM, MAG_SCHEDULE_MAX_DEN - 1, 0);
+
+	uint64_t now = 30 * 86400 * NS_PER_SEC;
+	CHECK(scheduler.OnTick(now));
+	uint64_t period = uint64_t(MAG_SCHEDULE_MAX_DEN - 1) * NS_PER_SEC / MAG_SCHEDULE_MAX_NUM;
+	CHECK(scheduler.GetWait(now) > 0 && scheduler.GetWait(now) <= period + 1);
+}
+
+static void CheckClamp(uint32_t num, uint32_t den, uint32_t expectNum, uint32_t expectDen)
+{
+	CHECK(CaptureScheduler::ClampRate(num, den));
+	CHECK(num == expectNum && den == expectDen);
+}
+
+static void TestClampRate()
+{
+	CheckClamp(30000, 1001, 30000, 1001);
+	CheckClamp(60, 2, 30, 1);
+	CheckClamp(MAG_SCHEDULE_MAX_NUM, MAG_SCHEDULE_MAX_DEN, MAG_SCHEDULE_MAX_NUM / 10000, MAG_SCHEDULE_MAX_DEN / 10000);
+
+	// 240000 / 1001 does not reduce, it is rounded to the nearest rate that fits
+	uint32_t num = 240000, den = 1001;
+	CHECK(CaptureScheduler::ClampRate(num, den));
+	CHECK(num <= MAG_SCHEDULE_MAX_NUM && den <= MAG_SCHEDULE_MAX_DEN);
+	double rate = double(num) / den;
+	CHECK(rate > 239.7 && rate < 239.8);
+
+	// beyond the limits in either direction
+	CheckClamp(0xFFFFFFFF, 1, MAG_SCHEDULE_MAX_NUM, 1);
+	CheckClamp(1, 0xFFFFFFFF, 1, MAG_SCHEDULE_MAX_DEN);
+
+	num = 0, den = 1;
+	CHECK(!CaptureScheduler::ClampRate(num, den));
+	num = 1, den = 0;
+	CHECK(!CaptureScheduler::ClampRate(num, den));
+
+	// Start takes any rate, out of range ones are clamped instead of overflowing
+	CaptureScheduler scheduler;
+	scheduler.Start(0xFFFFFFFF, 7, 0);
+	CHECK(scheduler.IsRunning());
+	CHECK(scheduler.GetDeadline(MAG_SCHEDULE_MAX_NUM) == NS_PER_SEC);
+}
+
+int main()
+{
+	TestDeadlines();
+	TestJitter();
+	TestStall();
+	TestLongRun();
+	TestClampRate();
+
+	printf("test_scheduler OK\n");
+	return 0;
+}
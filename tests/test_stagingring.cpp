@@ -0,0 +1,244 @@
+#include "StagingRing.h"
+#include "TestUtil.h"
+#include <vector>
+
+// Stands in for the GPU: a copy finishes gpuDelay presents after it was queued,
+// every slot holds the number of the frame copied into it
+class MockStagingDevice : public IStagingDevice {
+public:
+	uint32_t gpuDelay = 1;
+	uint32_t frame = 0; // the frame Copy writes, advanced by Present
+	uint32_t now = 0;   // in presents
+	bool bFailCopy = false;
+	bool bFailLock = false;
+	uint32_t created = 0;
+	int32_t locked = -1;
+
+	bool CreateSlots(uint32_t count) override
+	{
+		m_vContent.assign(count, ~0u);
+		m_vDoneAt.assign(count, 0);
+		created = count;
+		return true;
+	}
+
+	void ReleaseSlots() override
+	{
+		m_vContent.clear();
+		m_vDoneAt.clear();
+		created = 0;
+	}
+
+	bool Copy(uint32_t slot) override
+	{
+		CHECK(slot < created);
+		CHECK(locked != (int32_t)slot);
+		if (bFailCopy)
+			return false;
+
+		m_vContent[slot] = frame;
+		m_vDoneAt[slot] = now + gpuDelay;
+		return true;
+	}
+
+	bool IsReady(uint32_t slot) override { return now >= m_vDoneAt[slot]; }
+
+	bool Lock(uint32_t slot, ST_StagingLock &lock) override
+	{
+		CHECK(locked < 0);
+		if (bFailLock)
+			return false;
+
+		locked = (int32_t)slot;
+		lock.bits = (const uint8_t *)&m_vContent[slot];
+		lock.pitch = 4;
+		return true;
+	}
+
+	void Unlock(uint32_t slot) override
+	{
+		CHECK(locked == (int32_t)slot);
+		locked = -1;
+	}
+
+private:
+	std::vector<uint32_t> m_vContent;
+	std::vector<uint32_t> m_vDoneAt;
+};
+
+static int32_t ReadAndUnlock(StagingRing &ring, uint32_t slot, const ST_StagingLock &lock)
+{
+	int32_t ret = int32_t(*(const uint32_t *)lock.bits);
+	ring.Unlock(slot);
+	return ret;
+}
+
+// One present as CaptureDX9 does it: push the new frame, read the one that is due. Returns its number or -1
+static int32_t Present(StagingRing &ring, MockStagingDevice &device)
+{
+	device.frame++;
+	device.now++;
+
+	uint32_t slot;
+	if (!ring.Push(slot))
+		return -1;
+
+	if (!ring.HasDue())
+		return -1;
+
+	ST_StagingLock lock;
+	if (!ring.Pop(slot, lock))
+		return -1;
+
+	return ReadAndUnlock(ring, slot, lock);
+}
+
+// Latency k hands out frame N - k at present N, in order, and only stalls at k = 0
+static void TestLatency()
+{
+	for (uint32_t latency = 0; latency <= MAG_MAX_READBACK_LATENCY; latency++) {
+		MockStagingDevice device;
+		StagingRing ring;
+		CHECK(ring.Init(&device, latency));
+		CHECK(ring.IsInited());
+		CHECK(device.created == latency + 1);
+
+		for (int32_t i = 1; i <= 1000; i++) {
+			int32_t got = Present(ring, device);
+			CHECK(got == ((i > (int32_t)latency) ? i - (int32_t)latency : -1));
+			CHECK(ring.GetPending() == ((uint32_t)i < latency ? (uint32_t)i : latency));
+		}
+
+		ST_StagingStats stats = ring.GetStats();
+		CHECK(stats.latency == latency);
+		CHECK(stats.copies == 1000);
+		CHECK(stats.reads == 1000 - latency);
+		CHECK(stats.stalls == (latency ? 0u : 1000u));
+		CHECK(stats.dropped == 0);
+
+		ring.Uninit();
+		CHECK(!ring.IsInited());
+		CHECK(device.created == 0);
+		CHECK(ring.GetStats().dropped == latency); // still pending at Uninit
+	}
+
+	// a copy taking two presents is hidden by a latency of 2, and stalls every read at 1
+	for (uint32_t latency = 1; latency <= 2; latency++) {
+		MockStagingDevice device;
+		device.gpuDelay = 2;
+		StagingRing ring;
+		CHECK(ring.Init(&device, latency));
+		for (int i = 0; i < 100; i++)
+			Present(ring, device);
+		CHECK(ring.GetStats().stalls == ((latency == 2) ? 0u : 99u));
+	}
+}
+
+// HasDue only once more than latency copies are pending, a full ring drops its oldest copy
+static void TestDue()
+{
+	const uint32_t latency = 2;
+	MockStagingDevice device;
+	StagingRing ring;
+	CHECK(ring.Init(&device, latency));
+
+	uint32_t slot;
+	ST_StagingLock lock;
+	CHECK(!ring.HasDue());
+	CHECK(!ring.Pop(slot, lock));
+
+	for (uint32_t i = 1; i <= latency + 1; i++) {
+		device.frame = i;
+		CHECK(ring.Push(slot));
+		CHECK(ring.HasDue() == (i == latency + 1));
+	}
+
+	// two more pushes without a pop replace frames 1 and 2
+	device.frame = 4;
+	CHECK(ring.Push(slot));
+	device.frame = 5;
+	CHECK(ring.Push(slot));
+	CHECK(ring.GetPending() == latency + 1);
+	CHECK(ring.GetStats().dropped == 2);
+
+	CHECK(ring.Pop(slot, lock));
+	CHECK(ReadAndUnlock(ring, slot, lock) == 3);
+	CHECK(!ring.HasDue());
+	CHECK(ring.GetPending() == latency);
+}
+
+// Reset drops the pending copies and the ring fills up again, PopLatest reads the newest copy right away
+static void TestResetAndLatest()
+{
+	MockStagingDevice device;
+	StagingRing ring;
+	CHECK(ring.Init(&device, 10)); // clamped
+	CHECK(device.created == MAG_MAX_READBACK_LATENCY + 1);
+	CHECK(ring.GetStats().latency == MAG_MAX_READBACK_LATENCY);
+
+	Present(ring, device);
+	Present(ring, device);
+	CHECK(ring.GetPending() == 2);
+	ring.Reset();
+	CHECK(ring.GetPending() == 0);
+	CHECK(!ring.HasDue());
+	CHECK(ring.GetStats().dropped == 2);
+
+	for (uint32_t i = 0; i < MAG_MAX_READBACK_LATENCY; i++)
+		CHECK(Present(ring, device) == -1);
+	CHECK(Present(ring, device) == (int32_t)device.frame - MAG_MAX_READBACK_LATENCY);
+
+	// after a demand capture skip window: the newest copy, even though it is not due yet
+	uint32_t slot;
+	ST_StagingLock lock;
+	uint64_t dropped = ring.GetStats().dropped;
+	uint32_t pending = ring.GetPending();
+	device.frame++;
+	device.now++;
+	CHECK(ring.Push(slot));
+	CHECK(ring.PopLatest(slot, lock));
+	CHECK(ReadAndUnlock(ring, slot, lock) == (int32_t)device.frame);
+	CHECK(ring.GetPending() == 0);
+	CHECK(ring.GetStats().dropped == dropped + pending);
+	CHECK(!ring.PopLatest(slot, lock));
+
+	// the ring keeps its order afterwards
+	for (uint32_t i = 0; i < MAG_MAX_READBACK_LATENCY; i++)
+		CHECK(Present(ring, device) == -1);
+	CHECK(Present(ring, device) == (int32_t)device.frame - MAG_MAX_READBACK_LATENCY);
+}
+
+// A failed copy does not enter the ring, a failed lock takes its slot out of it
+static void TestFailures()
+{
+	MockStagingDevice device;
+	StagingRing ring;
+	CHECK(ring.Init(&device, 1));
+
+	device.bFailCopy = true;
+	CHECK(Present(ring, device) == -1);
+	CHECK(ring.GetPending() == 0);
+	CHECK(ring.GetStats().copies == 0);
+	device.bFailCopy = false;
+
+	CHECK(Present(ring, device) == -1);
+	device.bFailLock = true;
+	CHECK(Present(ring, device) == -1);
+	CHECK(ring.GetPending() == 1);
+	CHECK(ring.GetStats().dropped == 1);
+	device.bFailLock = false;
+
+	CHECK(Present(ring, device) == (int32_t)device.frame - 1);
+	CHECK(device.locked < 0);
+}
+
+int main()
+{
+	TestLatency();
+	TestDue();
+	TestResetAndLatest();
+	TestFailures();
+
+	printf("test_stagingring OK\n");
+	return 0;
+}
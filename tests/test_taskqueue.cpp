@@ -0,0 +1,153 @@
+#include "TaskQueue.hpp"
+#include "TestUtil.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Counts live copies, so a leaked or doubly destroyed capture shows up
+struct ST_Tracked {
+	static std::atomic<int> s_nLive;
+	ST_Tracked() { ++s_nLive; }
+	ST_Tracked(const ST_Tracked &) { ++s_nLive; }
+	ST_Tracked(ST_Tracked &&) { ++s_nLive; }
+	~ST_Tracked() { --s_nLive; }
+};
+std::atomic<int> ST_Tracked::s_nLive = {0};
+
+static void TestInlineTask()
+{
+	auto shared = std::make_shared<int>(0);
+	{
+		ST_Tracked tracked;
+		InlineTask task([shared, tracked]() { ++*shared; });
+		CHECK(task);
+		CHECK(shared.use_count() == 2);
+
+		InlineTask moved(std::move(task));
+		CHECK(!task && moved);
+		CHECK(shared.use_count() == 2);
+
+		moved();
+		moved();
+		CHECK(*shared == 2);
+
+		InlineTask assigned;
+		assigned = std::move(moved);
+		CHECK(!moved && assigned);
+
+		// Clear drops the captures right away, not when the task object goes
+		assigned.Clear();
+		CHECK(!assigned);
+		CHECK(shared.use_count() == 1);
+		CHECK(ST_Tracked::s_nLive == 1);
+	}
+	CHECK(ST_Tracked::s_nLive == 0);
+
+	// a task that is never run still releases its captures
+	{
+		InlineTask task([shared]() { ++*shared; });
+		CHECK(shared.use_count() == 2);
+	}
+	CHECK(shared.use_count() == 1);
+}
+
+static void TestFull()
+{
+	MpscQueue<InlineTask, 4> queue;
+	auto shared = std::make_shared<int>(0);
+	for (int i = 0; i < 4; i++) {
+		InlineTask task([shared, i]() { *shared += i; });
+		CHECK(queue.Push(task));
+		CHECK(!task);
+	}
+
+	// a full queue leaves the task with the caller
+	InlineTask rejected([shared]() { *shared += 100; });
+	CHECK(!queue.Push(rejected));
+	CHECK(rejected);
+
+	InlineTask out;
+	CHECK(queue.Pop(out));
+	out();
+	out.Clear();
+	CHECK(queue.Push(rejected));
+
+	int popped = 0;
+	while (queue.Pop(out)) {
+		out();
+		out.Clear();
+		popped++;
+	}
+	CHECK(popped == 4);
+	CHECK(*shared == 0 + 1 + 2 + 3 + 100);
+	CHECK(shared.use_count() == 1);
+}
+
+// Several producers against one consumer, every task runs exactly once and in order per producer.
+// A burst posts one wake-up, the consumer clears the flag before draining, as PushTask and RunTask do.
+static void TestProducers()
+{
+	const int producers = 4, tasksPerProducer = 100000;
+	static MpscQueue<InlineTask, 256> queue;
+	std::atomic<bool> posted = {false};
+	std::atomic<uint64_t> wakes = {0};
+	std::vector<int> lastSeen(producers, -1);
+	std::atomic<int> done = {0};
+	bool bOrdered = true;
+
+	std::thread consumer([&]() {
+		InlineTask task;
+		while (done.load() < producers || posted.load()) {
+			if (!posted.exchange(false, std::memory_order_acq_rel)) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			++wakes;
+			while (queue.Pop(task)) {
+				task();
+				task.Clear();
+			}
+		}
+	});
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&, p]() {
+			for (int i = 0; i < tasksPerProducer; i++) {
+				InlineTask task([&lastSeen, &bOrdered, p, i]() {
+					if (lastSeen[p] != i - 1)
+						bOrdered = false;
+					lastSeen[p] = i;
+				});
+
+				while (!queue.Push(task))
+					std::this_thread::yield();
+
+				posted.exchange(true, std::memory_order_acq_rel);
+			}
+			++done;
+		});
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+	consumer.join();
+
+	InlineTask rest;
+	CHECK(!queue.Pop(rest));
+	CHECK(bOrdered);
+	for (int p = 0; p < producers; p++)
+		CHECK(lastSeen[p] == tasksPerProducer - 1);
+	CHECK(wakes.load() <= uint64_t(producers) * tasksPerProducer);
+}
+
+int main()
+{
+	TestInlineTask();
+	TestFull();
+	TestProducers();
+
+	printf("test_taskqueue OK\n");
+	return 0;
+}